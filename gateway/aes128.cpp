@@ -0,0 +1,187 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "aes128.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define AES_NI_BUILD 1
+#endif
+
+namespace aes {
+
+// S-box and round tables, computed once from GF(2^8) arithmetic
+struct Tables {
+  uint8_t sbox[256];
+  uint32_t te[4][256];  // SubBytes + MixColumns of a byte in each row, big-endian column words
+
+  Tables() {
+    uint8_t p = 1, q = 1;
+    sbox[0] = 0x63;
+    do {
+      // p * 3, q / 3: walk the multiplicative group with the generator 3 and its inverse
+      p = p ^ (p << 1) ^ ((p & 0x80)? 0x1B : 0);
+      q ^= q << 1;
+      q ^= q << 2;
+      q ^= q << 4;
+      if(q & 0x80) q ^= 0x09;
+      const uint8_t x = q ^ rotl(q, 1) ^ rotl(q, 2) ^ rotl(q, 3) ^ rotl(q, 4);
+      sbox[p] = x ^ 0x63;
+    } while(p != 1);
+    for(unsigned i = 0; i < 256; ++i) {
+      const uint8_t s = sbox[i], s2 = xtime(s), s3 = s2 ^ s;
+      const uint32_t t = (uint32_t(s2) << 24) | (uint32_t(s) << 16) | (uint32_t(s) << 8) | s3;
+      te[0][i] = t;
+      for(unsigned r = 1; r < 4; ++r) te[r][i] = (t >> (8 * r)) | (t << (32 - 8 * r));
+    }
+  }
+
+  static uint8_t rotl(const uint8_t v, const unsigned n) { return uint8_t((v << n) | (v >> (8 - n))); }
+  static uint8_t xtime(const uint8_t v) { return uint8_t((v << 1) ^ ((v & 0x80)? 0x1B : 0)); }
+};
+
+static const Tables& tables() {
+  static const Tables t;
+  return t;
+}
+
+static uint32_t load32(const uint8_t* b) { return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3]; }
+static void store32(uint8_t* b, const uint32_t v) {
+  b[0] = v >> 24;
+  b[1] = v >> 16;
+  b[2] = v >> 8;
+  b[3] = v;
+}
+
+void expandKey(const uint8_t key[BLOCK], Key& k) {
+  const uint8_t* sbox = tables().sbox;
+  memcpy(k.rk, key, BLOCK);
+  uint8_t rcon = 1;
+  for(unsigned i = BLOCK; i < sizeof(k.rk); i += 4) {
+    uint8_t t[4];
+    memcpy(t, k.rk + i - 4, 4);
+    if(i % BLOCK == 0) {
+      const uint8_t t0 = t[0];
+      t[0] = sbox[t[1]] ^ rcon;
+      t[1] = sbox[t[2]];
+      t[2] = sbox[t[3]];
+      t[3] = sbox[t0];
+      rcon = Tables::xtime(rcon);
+    }
+    for(unsigned j = 0; j < 4; ++j) k.rk[i + j] = k.rk[i + j - BLOCK] ^ t[j];
+  }
+}
+
+static void encryptPortable(const Key& k, const uint8_t in[BLOCK], uint8_t out[BLOCK]) {
+  const Tables& tb = tables();
+  const uint8_t* rk = k.rk;
+  uint32_t s0 = load32(in) ^ load32(rk), s1 = load32(in + 4) ^ load32(rk + 4),
+    s2 = load32(in + 8) ^ load32(rk + 8), s3 = load32(in + 12) ^ load32(rk + 12);
+  for(unsigned r = 1; r < 10; ++r) {
+    rk += BLOCK;
+    const uint32_t t0 = tb.te[0][s0 >> 24] ^ tb.te[1][(s1 >> 16) & 0xFF] ^ tb.te[2][(s2 >> 8) & 0xFF] ^ tb.te[3][s3 & 0xFF] ^ load32(rk);
+    const uint32_t t1 = tb.te[0][s1 >> 24] ^ tb.te[1][(s2 >> 16) & 0xFF] ^ tb.te[2][(s3 >> 8) & 0xFF] ^ tb.te[3][s0 & 0xFF] ^ load32(rk + 4);
+    const uint32_t t2 = tb.te[0][s2 >> 24] ^ tb.te[1][(s3 >> 16) & 0xFF] ^ tb.te[2][(s0 >> 8) & 0xFF] ^ tb.te[3][s1 & 0xFF] ^ load32(rk + 8);
+    const uint32_t t3 = tb.te[0][s3 >> 24] ^ tb.te[1][(s0 >> 16) & 0xFF] ^ tb.te[2][(s1 >> 8) & 0xFF] ^ tb.te[3][s2 & 0xFF] ^ load32(rk + 12);
+    s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+  }
+  rk += BLOCK;
+  // the last round has no MixColumns
+  const uint8_t* sb = tb.sbox;
+  const uint32_t s[4] = {s0, s1, s2, s3};
+  for(unsigned c = 0; c < 4; ++c) {
+    const uint32_t v = (uint32_t(sb[s[c] >> 24]) << 24) | (uint32_t(sb[(s[(c + 1) & 3] >> 16) & 0xFF]) << 16) |
+      (uint32_t(sb[(s[(c + 2) & 3] >> 8) & 0xFF]) << 8) | sb[s[(c + 3) & 3] & 0xFF];
+    store32(out + 4 * c, v ^ load32(rk + 4 * c));
+  }
+}
+
+#ifdef AES_NI_BUILD
+__attribute__((target("aes,sse2")))
+static void encryptNi(const Key* const* keys, const uint8_t (*in)[BLOCK], uint8_t (*out)[BLOCK], const size_t n) {
+  // independent blocks interleaved, so the aesenc latency is hidden
+  const size_t W = 8;
+  size_t i = 0;
+  for(; i + W <= n; i += W) {
+    __m128i s[W];
+    for(size_t j = 0; j < W; ++j)
+      s[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in[i + j]), _mm_loadu_si128((const __m128i*)keys[i + j]->rk));
+    for(unsigned r = 1; r < 10; ++r)
+      for(size_t j = 0; j < W; ++j) s[j] = _mm_aesenc_si128(s[j], _mm_loadu_si128((const __m128i*)(keys[i + j]->rk + r * BLOCK)));
+    for(size_t j = 0; j < W; ++j)
+      _mm_storeu_si128((__m128i*)out[i + j], _mm_aesenclast_si128(s[j], _mm_loadu_si128((const __m128i*)(keys[i + j]->rk + 10 * BLOCK))));
+  }
+  for(; i < n; ++i) {
+    __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in[i]), _mm_loadu_si128((const __m128i*)keys[i]->rk));
+    for(unsigned r = 1; r < 10; ++r) s = _mm_aesenc_si128(s, _mm_loadu_si128((const __m128i*)(keys[i]->rk + r * BLOCK)));
+    _mm_storeu_si128((__m128i*)out[i], _mm_aesenclast_si128(s, _mm_loadu_si128((const __m128i*)(keys[i]->rk + 10 * BLOCK))));
+  }
+}
+#endif
+
+bool aesNiAvailable() {
+#ifdef AES_NI_BUILD
+  return __builtin_cpu_supports("aes");
+#else
+  return false;
+#endif
+}
+
+backend_t bestBackend() { return aesNiAvailable()? AES_NI : PORTABLE; }
+
+void encryptBlocks(const Key* const* keys, const uint8_t (*in)[BLOCK], uint8_t (*out)[BLOCK], const size_t n, const backend_t b) {
+#ifdef AES_NI_BUILD
+  if(b == AES_NI) {
+    encryptNi(keys, in, out, n);
+    return;
+  }
+#else
+  (void)b;
+#endif
+  for(size_t i = 0; i < n; ++i) encryptPortable(*keys[i], in[i], out[i]);
+}
+
+void encrypt(const Key& k, const uint8_t in[BLOCK], uint8_t out[BLOCK], const backend_t b) {
+  const Key* key = &k;
+  encryptBlocks(&key, (const uint8_t (*)[BLOCK])in, (uint8_t (*)[BLOCK])out, 1, b);
+}
+
+// doubling in GF(2^128)
+static void dbl(const uint8_t in[BLOCK], uint8_t out[BLOCK]) {
+  const uint8_t carry = in[0] >> 7;
+  for(unsigned i = 0; i < BLOCK - 1; ++i) out[i] = uint8_t((in[i] << 1) | (in[i + 1] >> 7));
+  out[BLOCK - 1] = uint8_t((in[BLOCK - 1] << 1) ^ (carry? 0x87 : 0));
+}
+
+void cmacInit(const uint8_t key[BLOCK], CmacKey& k) {
+  expandKey(key, k.aes);
+  uint8_t l[BLOCK] = {0};
+  encrypt(k.aes, l, l);
+  dbl(l, k.k1);
+  dbl(k.k1, k.k2);
+}
+
+void cmacLastBlock(const CmacKey& k, const uint8_t* msg, const size_t len, uint8_t block[BLOCK]) {
+  // a complete block is xored with K1, an incomplete one is padded with 10..0 and xored with K2
+  const uint8_t* sub = len == BLOCK? k.k1 : k.k2;
+  for(size_t i = 0; i < BLOCK; ++i) block[i] = sub[i] ^ (i < len? msg[i] : i == len? 0x80 : 0);
+}
+
+void cmac(const CmacKey& k, const uint8_t* msg, size_t len, uint8_t mac[BLOCK], const backend_t b) {
+  uint8_t x[BLOCK] = {0};
+  for(; len > BLOCK; msg += BLOCK, len -= BLOCK) {
+    for(size_t i = 0; i < BLOCK; ++i) x[i] ^= msg[i];
+    encrypt(k.aes, x, x, b);
+  }
+  uint8_t last[BLOCK];
+  cmacLastBlock(k, msg, len, last);
+  for(size_t i = 0; i < BLOCK; ++i) x[i] ^= last[i];
+  encrypt(k.aes, x, mac, b);
+}
+
+}
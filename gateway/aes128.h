@@ -0,0 +1,51 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * AES-128 encryption (FIPS-197) and AES-CMAC (RFC 4493): portable table-based code and an AES-NI path
+ * for x86, picked at run time. Only what MIC verification needs: no decryption.
+ */
+
+#ifndef GATEWAY_AES128_H
+#define GATEWAY_AES128_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace aes {
+
+const size_t BLOCK = 16;
+
+struct Key {
+  uint8_t rk[11 * BLOCK];  // round keys, byte order as in FIPS-197 (AES-NI loads them as is)
+};
+
+enum backend_t { PORTABLE, AES_NI };
+
+bool aesNiAvailable();
+backend_t bestBackend();
+
+void expandKey(const uint8_t key[BLOCK], Key& k);
+void encrypt(const Key& k, const uint8_t in[BLOCK], uint8_t out[BLOCK], backend_t b = PORTABLE);
+// n blocks, each with its own key; AES-NI runs several blocks through the rounds at once
+void encryptBlocks(const Key* const* keys, const uint8_t (*in)[BLOCK], uint8_t (*out)[BLOCK], size_t n, backend_t b);
+
+struct CmacKey {
+  Key aes;
+  uint8_t k1[BLOCK];  // subkeys
+  uint8_t k2[BLOCK];
+};
+
+void cmacInit(const uint8_t key[BLOCK], CmacKey& k);
+void cmac(const CmacKey& k, const uint8_t* msg, size_t len, uint8_t mac[BLOCK], backend_t b = PORTABLE);
+// the last CMAC block of a message of up to one block: padded, xored with the subkey;
+// its encryption is the CMAC
+void cmacLastBlock(const CmacKey& k, const uint8_t* msg, size_t len, uint8_t block[BLOCK]);
+
+}
+
+#endif
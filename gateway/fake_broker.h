@@ -0,0 +1,72 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * In-process MQTT broker for tests and the benchmark: parses what the client sends, keeps retained messages,
+ * acks QoS 1 publishes (acks can be held back to test in-flight limits)
+ */
+
+#ifndef GATEWAY_FAKE_BROKER_H
+#define GATEWAY_FAKE_BROKER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "mqtt.h"
+
+class FakeBroker : public mqtt::Link {
+public:
+  bool holdAcks = false;
+  bool connected = true;    // false - the link is lost
+  bool keepMessages = true; // the benchmark only counts them
+  std::vector<mqtt::Publish> messages;
+  std::map<std::string, std::string> retained;
+  uint64_t published = 0;
+  uint64_t bytes = 0;
+  uint64_t sends = 0;
+  uint64_t malformed = 0;
+
+  bool send(const uint8_t* data, const size_t len) override {
+    if(!connected) return false;
+    ++sends;
+    bytes += len;
+    for(size_t i = 0; i < len; ) {
+      mqtt::Packet p;
+      const int n = mqtt::parse(data + i, len - i, p);
+      if(n <= 0) { ++malformed; break; } // the client sends whole packets
+      i += n;
+      mqtt::Publish pub;
+      if(p.type == mqtt::CONNECT) ack(mqtt::CONNACK, 0);
+      else if(mqtt::parsePublish(p, pub)) {
+        ++published;
+        if(pub.qos) ack(mqtt::PUBACK, pub.packetId);
+        if(pub.retain) retained[pub.topic] = pub.payload;
+        if(keepMessages) messages.push_back(pub);
+      } else ++malformed;
+    }
+    return true;
+  }
+
+  bool receive(std::vector<uint8_t>& buf) override {
+    if(!connected) return false;
+    if(!holdAcks) {
+      buf.insert(buf.end(), out.begin(), out.end());
+      out.clear();
+    }
+    return true;
+  }
+
+private:
+  std::vector<uint8_t> out;
+
+  void ack(const uint8_t type, const uint16_t id) {
+    const uint8_t p[] = {uint8_t(type << 4), 2, uint8_t(id >> 8), uint8_t(id & 0xFF)};
+    out.insert(out.end(), p, p + sizeof(p));
+  }
+};
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "ingest.h"
+#include <string.h>
+
+namespace {
+
+// stage latency of a timed advert: each call closes a stage started by the previous one
+class Stages {
+public:
+  Stages(trace::Slot* slot, const uint64_t reportTicks, const bool timed) : slot(timed? slot : nullptr) {
+    if(this->slot) {
+      t = trace::now();
+      this->slot->latency(trace::REPORT, t - reportTicks);
+    }
+  }
+  void end(const trace::stage_t s) {
+    if(!slot) return;
+    const uint64_t n = trace::now();
+    slot->latency(s, n - t);
+    t = n;
+  }
+
+private:
+  trace::Slot* const slot;
+  uint64_t t = 0;
+};
+
+}
+
+void Ingest::report(const RawAdvert& a) {
+  // separate copies, so that neither the untraced path nor the untimed one carries the code of the others
+  if(!trace::enabled()) report<false, false>(a);
+  else {
+    if(!slot) slot = &trace::local();
+    if(a.reportTicks - sampledTicks < sampleTicks) report<true, false>(a);
+    else {
+      sampledTicks = a.reportTicks;
+      report<true, true>(a);
+    }
+  }
+}
+
+template<bool traced, bool timed>
+void Ingest::report(const RawAdvert& a) {
+  const auto it = last.find(a.mac);
+  Last* l = it == last.end()? nullptr : &it->second;
+  Stages stages(slot, a.reportTicks, timed);
+
+  if(!a.crcOk) {
+    if(traced) count(l, trace::CRC_FAILURES);
+    return;
+  }
+
+  wnode::Reading r;
+  const bool decoded = a.len <= sizeof(a.data) && wnode::decodeAdvert(a.data, a.len, a.mac, a.timeMs, r);
+  stages.end(trace::DECODE);
+  if(!decoded) {
+    if(traced) count(l, trace::DECODE_REJECTS);
+    return;
+  }
+
+  if(!l) {
+    l = &last[a.mac];
+    memset(l, 0, sizeof(*l));
+  }
+  const bool copy = l->len == a.len && a.timeMs - l->timeMs < cfg.dedupMs && !memcmp(l->data, a.data, a.len);
+  if(!copy) {
+    l->timeMs = a.timeMs;
+    l->len = a.len;
+    memcpy(l->data, a.data, a.len);
+  }
+  stages.end(trace::DEDUP);
+  if(copy) {
+    if(traced) count(l, trace::DUPLICATES);
+    return;
+  }
+
+  coalescer.push(r);
+  stages.end(trace::AGGREGATE);
+  if(traced) count(l, trace::ACCEPTED);
+  ++acceptedCount;
+}
+
+size_t Ingest::tick(const uint32_t nowMs) {
+  if(slot && nowMs - foldedMs >= cfg.countersMs) {
+    foldCounters();
+    foldedMs = nowMs;
+  }
+  if(!coalescer.due(nowMs)) return 0;
+  const uint64_t t = trace::enabled()? trace::now() : 0;
+  coalescer.take(nowMs, batch);
+  for(const wnode::Reading& r : batch) store.update(r);
+  store.flush(nowMs);
+  store.poll();
+  if(t) (slot? *slot : *(slot = &trace::local())).latency(trace::STORE, trace::now() - t);
+  return batch.size();
+}
+
+// adds what the reports counted since the last call to the slot
+void Ingest::foldCounters() {
+  for(auto& e : last) {
+    Last& l = e.second;
+    uint32_t any = 0;
+    for(const uint32_t c : l.pending) any |= c;
+    if(!any) continue;
+    if(!l.traced) l.traced = slot->node(e.first);
+    for(unsigned c = 0; c < trace::COUNTERS; ++c) slot->count(l.traced, trace::counter_t(c), l.pending[c]);
+    slot->seen(l.traced, l.timeMs);
+    memset(l.pending, 0, sizeof(l.pending));
+  }
+}
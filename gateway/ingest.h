@@ -0,0 +1,86 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * Ingest of one scanner thread: radio report -> decode -> dedup -> aggregate -> store.
+ * Copies of an advert on other channels (the same data from the same MAC within dedupMs) are dropped, readings
+ * are coalesced per node and handed to the publisher once per batchMs.
+ * Tracing (trace.h), by the one thread that runs the Ingest:
+ * - every report adds to one counter of its node. The counters sit next to the node's dedup state, which the report
+ *   touches anyway, and reach the thread's slot once per countersMs in tick(): a node reports a few times a second,
+ *   so moving them more often would cost as much as counting in the slot directly. A MAC becomes a node with its
+ *   first decoded advert, reports of other MACs go to the slot's shared entry;
+ * - stage latencies are taken for at most one advert per sampleUs of reportTicks, as two clock reads cost about as
+ *   much as a stage: a fixed number per second under load, every advert under a light one; the store per batch.
+ */
+
+#ifndef GATEWAY_INGEST_H
+#define GATEWAY_INGEST_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "mqtt_publisher.h"
+#include "trace.h"
+#include "wnode_scan.h"
+
+struct RawAdvert {
+  uint64_t mac = 0;
+  uint64_t reportTicks = 0;  // trace::now() when the scanner reported it, 0 - not timed
+  uint32_t timeMs = 0;       // scanner clock
+  bool crcOk = true;
+  uint8_t len = 0;
+  uint8_t data[31];
+};
+
+struct IngestConfig {
+  uint32_t dedupMs = 100;
+  uint32_t batchMs = 1000;
+  uint32_t sampleUs = 1000;    // 0 - time every advert
+  uint32_t countersMs = 10000; // per-node counters reach the trace slot at least this often
+};
+
+class Ingest {
+public:
+  explicit Ingest(MqttPublisher& store, const IngestConfig& cfg = IngestConfig())
+    : cfg(cfg), coalescer(cfg.batchMs), store(store), sampleTicks(uint64_t(cfg.sampleUs * 1000. / trace::nsPerTick())) {}
+
+  void report(const RawAdvert& a);
+  // hands the coalesced readings to the publisher if a batch is due, returns their number
+  size_t tick(uint32_t nowMs);
+  // reports that made it to the aggregate stage
+  uint64_t accepted() const { return acceptedCount; }
+
+private:
+  struct Last {
+    uint32_t timeMs;    // of the last advert that wasn't a copy, the node's last seen
+    uint32_t pending[trace::COUNTERS];  // not yet in the slot
+    trace::Slot::Node* traced;          // set by the first move
+    uint8_t len;
+    uint8_t data[31];
+  };
+
+  template<bool traced, bool timed> void report(const RawAdvert& a);
+  void count(Last* l, trace::counter_t c) {
+    if(l) ++l->pending[c];
+    else slot->count(slot->other(), c);
+  }
+  void foldCounters();
+
+  const IngestConfig cfg;
+  std::unordered_map<uint64_t, Last> last;  // by MAC, for dedup
+  wnode::Coalescer coalescer;
+  MqttPublisher& store;
+  std::vector<wnode::Reading> batch;
+  trace::Slot* slot = nullptr;  // this thread's, taken on the first traced report
+  uint32_t foldedMs = 0;
+  const uint64_t sampleTicks;
+  uint64_t sampledTicks = 0;    // reportTicks of the last timed advert
+  uint64_t acceptedCount = 0;
+};
+
+#endif
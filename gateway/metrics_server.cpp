@@ -0,0 +1,104 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "metrics_server.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+static const int REQUEST_TIMEOUT_MS = 1000;
+
+MetricsServer::~MetricsServer() { close(); }
+
+void MetricsServer::close() {
+  if(fd >= 0) ::close(fd);
+  fd = -1;
+}
+
+bool MetricsServer::listen(const uint16_t port, const bool loopbackOnly) {
+  close();
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  const int one = 1;
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(loopbackOnly? INADDR_LOOPBACK : INADDR_ANY);
+  socklen_t len = sizeof(addr);
+  if(fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) || bind(fd, (sockaddr*)&addr, sizeof(addr))
+    || ::listen(fd, 8) || getsockname(fd, (sockaddr*)&addr, &len)) {
+    fprintf(stderr, "metrics port %u: %s\n", port, strerror(errno));
+    close();
+    return false;
+  }
+  boundPort = ntohs(addr.sin_port);
+  return true;
+}
+
+int MetricsServer::poll(const int timeoutMs) {
+  if(fd < 0) return 0;
+  int served = 0;
+  for(int wait = timeoutMs; ; wait = 0) {
+    pollfd p = {fd, POLLIN, 0};
+    if(::poll(&p, 1, wait) <= 0) return served;
+    const int client = accept(fd, nullptr, nullptr);
+    if(client < 0) return served;
+    serve(client);
+    ::close(client);
+    ++served;
+  }
+}
+
+static bool sendAll(const int fd, const char* data, size_t len) {
+  while(len) {
+    const ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if(n <= 0) return false;
+    data += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+void MetricsServer::serve(const int client) {
+  // the request line is all that matters
+  std::string req;
+  char buf[512];
+  while(req.find("\r\n\r\n") == std::string::npos && req.size() < 4096) {
+    pollfd p = {client, POLLIN, 0};
+    if(::poll(&p, 1, REQUEST_TIMEOUT_MS) <= 0) return;
+    const ssize_t n = recv(client, buf, sizeof(buf), 0);
+    if(n <= 0) break;
+    req.append(buf, size_t(n));
+  }
+
+  std::string type = "text/plain; version=0.0.4", status = "200 OK", body;
+  if(req.compare(0, 13, "GET /metrics ") == 0 || req.compare(0, 14, "GET /metrics\r\n") == 0) {
+    trace::Snapshot s;
+    trace::snapshot(s);
+    body = trace::prometheusText(s);
+  } else if(req.compare(0, 14, "GET /snapshot ") == 0 || req.compare(0, 15, "GET /snapshot\r\n") == 0) {
+    trace::Snapshot s;
+    trace::snapshot(s);
+    std::vector<uint8_t> bin;
+    trace::writeBinary(s, bin);
+    body.assign(bin.begin(), bin.end());
+    type = "application/octet-stream";
+  } else {
+    status = "404 Not Found";
+    body = "/metrics or /snapshot\n";
+    type = "text/plain";
+  }
+  const std::string head = "HTTP/1.0 " + status + "\r\nContent-Type: " + type
+    + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+  if(sendAll(client, head.data(), head.size())) sendAll(client, body.data(), body.size());
+}
@@ -0,0 +1,34 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * Trace endpoint over HTTP/1.0, POSIX sockets: GET /metrics - Prometheus text, GET /snapshot - binary dump.
+ * Served from the caller's loop (poll()), one request per connection; a snapshot is taken per request.
+ */
+
+#ifndef GATEWAY_METRICS_SERVER_H
+#define GATEWAY_METRICS_SERVER_H
+
+#include <stdint.h>
+
+class MetricsServer {
+public:
+  ~MetricsServer();
+  // port 0 - any free one (see port()), false on failure (the reason goes to stderr)
+  bool listen(uint16_t port, bool loopbackOnly = true);
+  uint16_t port() const { return boundPort; }
+  // serves connections coming within timeoutMs, returns the number of requests served
+  int poll(int timeoutMs);
+
+private:
+  int fd = -1;
+  uint16_t boundPort = 0;
+  void close();
+  void serve(int client);
+};
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "mic_verify.h"
+#include <string.h>
+#include "wnode_frame.h"
+
+using aes::BLOCK;
+
+// frames per pass: block buffers stay on the stack
+static const size_t BATCH = 64;
+
+size_t verifyMics(const MicCheck* frames, const size_t n, bool* ok, const aes::backend_t b) {
+  size_t good = 0;
+  for(size_t start = 0; start < n; start += BATCH) {
+    const size_t m = n - start < BATCH? n - start : BATCH;
+    // frames of up to one block go through AES together
+    const aes::Key* keys[BATCH];
+    uint8_t in[BATCH][BLOCK], out[BATCH][BLOCK], macs[BATCH][BLOCK];
+    size_t idx[BATCH], k = 0;
+    for(size_t i = 0; i < m; ++i) {
+      const MicCheck& f = frames[start + i];
+      if(f.len < WNODE_AUTH_MIC_LEN) continue; // can't match
+      if(f.len - WNODE_AUTH_MIC_LEN <= BLOCK) {
+        keys[k] = &f.key->aes;
+        aes::cmacLastBlock(*f.key, f.frame, f.len - WNODE_AUTH_MIC_LEN, in[k]);
+        idx[k++] = i;
+      } else aes::cmac(*f.key, f.frame, f.len - WNODE_AUTH_MIC_LEN, macs[i], b); // longer than any v2 frame
+    }
+    aes::encryptBlocks(keys, in, out, k, b);
+    for(size_t j = 0; j < k; ++j) memcpy(macs[idx[j]], out[j], BLOCK);
+
+    for(size_t i = 0; i < m; ++i) {
+      const MicCheck& f = frames[start + i];
+      uint8_t diff = f.len < WNODE_AUTH_MIC_LEN;
+      // no early exit: time doesn't tell how much of a forged MIC matches
+      if(!diff) for(size_t j = 0; j < WNODE_AUTH_MIC_LEN; ++j) diff |= macs[i][j] ^ f.frame[f.len - WNODE_AUTH_MIC_LEN + j];
+      ok[start + i] = !diff;
+      good += !diff;
+    }
+  }
+  return good;
+}
+
+void signFrame(const aes::CmacKey& key, uint8_t* frame, const size_t len) {
+  uint8_t mac[BLOCK];
+  aes::cmac(key, frame, len, mac);
+  memcpy(frame + len, mac, WNODE_AUTH_MIC_LEN);
+}
+
+bool authCounter(const uint8_t* frame, const size_t len, uint32_t& counter) {
+  // records start after the UUID
+  size_t last = 0;
+  for(size_t i = 2; i < len; i += 1 + (frame[i] & 0xF)) last = i;
+  if(!last || last + 1 + WNODE_TLV_AUTH_DATA_LEN != len || frame[last] != WNODE_TLV_HEADER(WNODE_TLV_AUTH_DATA, WNODE_TLV_AUTH_DATA_LEN))
+    return false;
+  const uint8_t* c = frame + len - WNODE_AUTH_MIC_LEN - 3;
+  counter = (uint32_t(c[0]) << 16) | (uint32_t(c[1]) << 8) | c[2];
+  return true;
+}
+
+bool ReplayGuard::accept(const uint64_t node, const uint32_t counter) {
+  const auto it = last.find(node);
+  if(it == last.end()) {
+    last.emplace(node, counter);
+    return true;
+  }
+  if(counter < it->second) return false;
+  it->second = counter;
+  return true;
+}
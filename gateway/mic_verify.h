@@ -0,0 +1,47 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * Authenticated v2 frames (WNODE_TLV_AUTH_DATA, see wnode_frame.h): the record goes last and ends with a MIC,
+ * the first WNODE_AUTH_MIC_LEN bytes of AES-CMAC with the node key over the service data before it
+ * (UUID as on air, records, counter). A frame of up to 16 bytes before the MIC takes one AES block,
+ * so a batch is checked as independent blocks in one pass (interleaved with AES-NI).
+ */
+
+#ifndef GATEWAY_MIC_VERIFY_H
+#define GATEWAY_MIC_VERIFY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unordered_map>
+#include "aes128.h"
+
+struct MicCheck {
+  const aes::CmacKey* key;  // of the node the frame claims to be from
+  const uint8_t* frame;     // service data
+  size_t len;               // MIC included
+};
+
+// ok[i] - the MIC of frames[i] matches; returns the number of good frames
+size_t verifyMics(const MicCheck* frames, size_t n, bool* ok, aes::backend_t b = aes::bestBackend());
+
+// writes the MIC after len bytes of the frame (what a node does)
+void signFrame(const aes::CmacKey& key, uint8_t* frame, size_t len);
+
+// counter of an authenticated frame, false if the last record isn't WNODE_TLV_AUTH_DATA
+bool authCounter(const uint8_t* frame, size_t len, uint32_t& counter);
+
+// rejects replayed frames: a node's counter must not go back; the same counter is a copy on another channel
+class ReplayGuard {
+public:
+  bool accept(uint64_t node, uint32_t counter);
+
+private:
+  std::unordered_map<uint64_t, uint32_t> last;
+};
+
+#endif
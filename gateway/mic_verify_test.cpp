@@ -0,0 +1,128 @@
+/*
+ * AES-128 and AES-CMAC against FIPS-197 / RFC 4493 vectors with both backends,
+ * batch MIC verification of authenticated v2 frames, counters and replays
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "mic_verify.h"
+#include "wnode_frame.h"
+
+using aes::BLOCK;
+
+static unsigned fails = 0;
+#define CHECK(cond) do { if(!(cond)) { ++fails; printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while(0)
+
+static std::vector<uint8_t> hex(const char* s) {
+  std::vector<uint8_t> v;
+  for(; s[0] && s[1]; s += 2) {
+    unsigned b;
+    sscanf(s, "%2x", &b);
+    v.push_back(uint8_t(b));
+  }
+  return v;
+}
+
+static std::vector<aes::backend_t> backends() {
+  std::vector<aes::backend_t> b = {aes::PORTABLE};
+  if(aes::aesNiAvailable()) b.push_back(aes::AES_NI);
+  else printf("no AES-NI, portable backend only\n");
+  return b;
+}
+
+static void vectors() {
+  // FIPS-197 appendix C.1
+  aes::Key k;
+  aes::expandKey(hex("000102030405060708090a0b0c0d0e0f").data(), k);
+  CHECK(!memcmp(k.rk + 10 * BLOCK, hex("13111d7fe3944a17f307a78b4d2b30c5").data(), BLOCK));
+  for(const aes::backend_t b : backends()) {
+    uint8_t out[BLOCK];
+    aes::encrypt(k, hex("00112233445566778899aabbccddeeff").data(), out, b);
+    CHECK(!memcmp(out, hex("69c4e0d86a7b0430d8cdb78070b4c55a").data(), BLOCK));
+  }
+
+  // RFC 4493 section 4
+  aes::CmacKey ck;
+  aes::cmacInit(hex("2b7e151628aed2a6abf7158809cf4f3c").data(), ck);
+  CHECK(!memcmp(ck.k1, hex("fbeed618357133667c85e08f7236a8de").data(), BLOCK));
+  CHECK(!memcmp(ck.k2, hex("f7ddac306ae266ccf90bc11ee46d513b").data(), BLOCK));
+  const std::vector<uint8_t> msg = hex(
+    "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+    "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+  const struct { size_t len; const char* mac; } cases[] = {
+    {0, "bb1d6929e95937287fa37d129b756746"},
+    {16, "070a16b46b4d4144f79bdd9dd04a287c"},
+    {40, "dfa66747de9ae63030ca32611497c827"},
+    {64, "51f0bebf7e3b9d92fc49741779363cfe"}
+  };
+  for(const aes::backend_t b : backends()) for(const auto& c : cases) {
+    uint8_t mac[BLOCK];
+    aes::cmac(ck, msg.data(), c.len, mac, b);
+    CHECK(!memcmp(mac, hex(c.mac).data(), BLOCK));
+  }
+}
+
+// service data of an authenticated frame: UUID, status data record; MIC not written yet
+static const size_t FRAME_LEN = 2 + 1 + WNODE_TLV_AUTH_DATA_LEN;
+static void authFrame(uint8_t* f, const uint32_t counter, const int16_t temperature) {
+  const uint8_t data[] = {
+    WNODE_UUID16_V2 & 0xFF, WNODE_UUID16_V2 >> 8,
+    WNODE_TLV_HEADER(WNODE_TLV_AUTH_DATA, WNODE_TLV_AUTH_DATA_LEN),
+    0x01, 0xC8, uint8_t(temperature >> 8), uint8_t(temperature), 0x00,
+    uint8_t(counter >> 16), uint8_t(counter >> 8), uint8_t(counter)
+  };
+  static_assert(sizeof(data) + WNODE_AUTH_MIC_LEN == FRAME_LEN, "record length");
+  memcpy(f, data, sizeof(data));
+}
+
+static void frames() {
+  static_assert(FRAME_LEN - 2 <= WNODE_TLV_SPACE, "authenticated frame fits v2 payload");
+  const size_t NODES = 5, N = 150; // more than a pass, not a multiple of the interleave
+  std::vector<aes::CmacKey> keys(NODES);
+  for(size_t i = 0; i < NODES; ++i) {
+    uint8_t key[BLOCK];
+    for(size_t j = 0; j < BLOCK; ++j) key[j] = uint8_t(i * 31 + j);
+    aes::cmacInit(key, keys[i]);
+  }
+  std::vector<uint8_t> buf(N * FRAME_LEN);
+  std::vector<MicCheck> checks(N);
+  for(size_t i = 0; i < N; ++i) {
+    uint8_t* f = &buf[i * FRAME_LEN];
+    authFrame(f, uint32_t(i), int16_t(200 + i));
+    signFrame(keys[i % NODES], f, FRAME_LEN - WNODE_AUTH_MIC_LEN);
+    checks[i] = {&keys[i % NODES], f, FRAME_LEN};
+  }
+  // forged: data changed, MIC changed, wrong key, too short
+  buf[7 * FRAME_LEN + 5] ^= 1;
+  buf[8 * FRAME_LEN + FRAME_LEN - 1] ^= 0x80;
+  checks[9].key = &keys[(9 + 1) % NODES];
+  checks[10].len = 3;
+
+  for(const aes::backend_t b : backends()) {
+    bool ok[N];
+    CHECK(verifyMics(checks.data(), N, ok, b) == N - 4);
+    CHECK(!ok[7] && !ok[8] && !ok[9] && !ok[10] && ok[0] && ok[11] && ok[N - 1]);
+  }
+
+  uint32_t counter = 0;
+  CHECK(authCounter(&buf[0x42 * FRAME_LEN], FRAME_LEN, counter) && counter == 0x42);
+  CHECK(!authCounter(&buf[0], FRAME_LEN - 1, counter));
+  const uint8_t plain[] = {0x53, 0xA9, WNODE_TLV_HEADER(WNODE_TLV_TEMPERATURE, 2), 0x00, 0xFA};
+  CHECK(!authCounter(plain, sizeof(plain), counter));
+
+  ReplayGuard guard;
+  CHECK(guard.accept(1, 10));
+  CHECK(guard.accept(1, 10)); // a copy on another channel
+  CHECK(guard.accept(2, 3));
+  CHECK(guard.accept(1, 11));
+  CHECK(!guard.accept(1, 10));
+}
+
+int main()
+{
+  vectors();
+  frames();
+  printf("mic_verify_test: %s\n", fails? "FAIL" : "OK");
+  return fails? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "mqtt.h"
+
+namespace mqtt {
+
+static void appendLength(std::vector<uint8_t>& out, size_t len) {
+  do {
+    uint8_t b = len & 0x7F;
+    len >>= 7;
+    if(len) b |= 0x80;
+    out.push_back(b);
+  } while(len);
+}
+
+static void append16(std::vector<uint8_t>& out, const uint16_t v) {
+  out.push_back(v >> 8);
+  out.push_back(v & 0xFF);
+}
+
+static void appendString(std::vector<uint8_t>& out, const std::string& s) {
+  append16(out, uint16_t(s.size()));
+  out.insert(out.end(), s.begin(), s.end());
+}
+
+void appendConnect(std::vector<uint8_t>& out, const std::string& clientId, const uint16_t keepAliveS) {
+  out.push_back(CONNECT << 4);
+  appendLength(out, 10 + 2 + clientId.size());
+  appendString(out, "MQTT");
+  out.push_back(4);     // protocol level 3.1.1
+  out.push_back(0x02);  // clean session
+  append16(out, keepAliveS);
+  appendString(out, clientId);
+}
+
+void appendPublish(std::vector<uint8_t>& out, const std::string& topic, const std::string& payload,
+  const uint8_t qos, const bool retain, const uint16_t packetId)
+{
+  out.push_back((PUBLISH << 4) | (qos << 1) | (retain? 1 : 0));
+  appendLength(out, 2 + topic.size() + (qos? 2 : 0) + payload.size());
+  appendString(out, topic);
+  if(qos) append16(out, packetId);
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+int parse(const uint8_t* buf, const size_t len, Packet& p) {
+  size_t bodyLen = 0, i = 1;
+  for(unsigned shift = 0; ; shift += 7, ++i) {
+    if(i >= len) return 0;
+    if(shift > 21) return -1;
+    bodyLen |= size_t(buf[i] & 0x7F) << shift;
+    if(!(buf[i] & 0x80)) break;
+  }
+  ++i;
+  if(len - i < bodyLen) return 0;
+  p.type = buf[0] >> 4;
+  p.flags = buf[0] & 0xF;
+  p.body = buf + i;
+  p.bodyLen = bodyLen;
+  return int(i + bodyLen);
+}
+
+bool parsePublish(const Packet& p, Publish& pub) {
+  if(p.type != PUBLISH || p.bodyLen < 2) return false;
+  pub.qos = (p.flags >> 1) & 0x3;
+  pub.retain = p.flags & 1;
+  const size_t topicLen = (p.body[0] << 8) | p.body[1];
+  size_t i = 2 + topicLen;
+  if(pub.qos > 2 || i + (pub.qos? 2 : 0) > p.bodyLen) return false;
+  pub.topic.assign((const char*)p.body + 2, topicLen);
+  pub.packetId = 0;
+  if(pub.qos) {
+    pub.packetId = (p.body[i] << 8) | p.body[i + 1];
+    i += 2;
+  }
+  pub.payload.assign((const char*)p.body + i, p.bodyLen - i);
+  return true;
+}
+
+}
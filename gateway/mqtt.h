@@ -0,0 +1,66 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * MQTT 3.1.1 packets the publisher needs: CONNECT, PUBLISH out, CONNACK and PUBACK in
+ */
+
+#ifndef GATEWAY_MQTT_H
+#define GATEWAY_MQTT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace mqtt {
+
+enum packet_t : uint8_t {
+  CONNECT = 1,
+  CONNACK = 2,
+  PUBLISH = 3,
+  PUBACK = 4
+};
+
+// where packets go: a broker connection or the in-process fake broker
+class Link {
+public:
+  virtual ~Link() {}
+  // sends the whole buffer, false if the connection is lost
+  virtual bool send(const uint8_t* data, size_t len) = 0;
+  // appends whatever the broker has sent (without blocking), false if the connection is lost
+  virtual bool receive(std::vector<uint8_t>& buf) = 0;
+};
+
+void appendConnect(std::vector<uint8_t>& out, const std::string& clientId, uint16_t keepAliveS);
+// packetId is used for qos > 0 only
+void appendPublish(std::vector<uint8_t>& out, const std::string& topic, const std::string& payload,
+  uint8_t qos, bool retain, uint16_t packetId);
+
+struct Packet {
+  uint8_t type;         // packet_t
+  uint8_t flags;        // low nibble of the fixed header
+  const uint8_t* body;  // variable header + payload
+  size_t bodyLen;
+};
+
+// parses a packet at the start of buf: returns its total length, 0 if it isn't complete yet, -1 if it's malformed
+int parse(const uint8_t* buf, size_t len, Packet& p);
+
+// fields of a PUBLISH packet body, false if malformed
+struct Publish {
+  std::string topic;
+  std::string payload;
+  uint8_t qos;
+  bool retain;
+  uint16_t packetId;
+};
+bool parsePublish(const Packet& p, Publish& pub);
+
+}
+
+#endif
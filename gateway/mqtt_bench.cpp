@@ -0,0 +1,96 @@
+/*
+ * Publisher load with many nodes: every node polls its sensor every 2 min and advertises every 2 s
+ * on 3 channels (a scanner reports each copy), simulated time runs as fast as it can.
+ * Reports messages/s and bytes/s the broker gets per second of simulated time, compared to publishing
+ * every advert, and how many adverts/s the publisher takes in wall time.
+ *
+ * mqtt_bench [nodes] [minutes] [host:port] - with host:port publishes to a real broker (e.g. local mosquitto),
+ *   otherwise to the in-process fake one
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include "mqtt_publisher.h"
+#include "fake_broker.h"
+#include "tcp_link.h"
+
+static const uint32_t ADVERT_MS = 2000;
+static const uint32_t POLL_MS = 120000;
+static const uint32_t FLUSH_MS = 1000;
+static const unsigned CHANNELS = 3;
+
+int main(int argc, char** argv)
+{
+  const unsigned nodes = argc > 1? atoi(argv[1]) : 500;
+  const unsigned minutes = argc > 2? atoi(argv[2]) : 60;
+
+  FakeBroker fake;
+  fake.keepMessages = false;
+  TcpLink tcp;
+  mqtt::Link* link = &fake;
+  if(argc > 3) {
+    const std::string target = argv[3];
+    const size_t colon = target.rfind(':');
+    const uint16_t port = colon == std::string::npos? 1883 : atoi(target.c_str() + colon + 1);
+    if(!tcp.connect(target.substr(0, colon), port, "wnode-bench")) return 1;
+    link = &tcp;
+  }
+
+  MqttPublisher pub(*link);
+  std::mt19937 rnd(1);
+  std::vector<wnode::Reading> readings(nodes);
+  std::vector<uint32_t> phase(nodes);
+  for(unsigned i = 0; i < nodes; ++i) {
+    readings[i].mac = 0xC0FFEE000000ULL + i;
+    readings[i].fields = wnode::Reading::HAS_DATA;
+    readings[i].temperature = 200 + rnd() % 50;
+    readings[i].humidity = 400 + rnd() % 200;
+    phase[i] = rnd() % ADVERT_MS;
+  }
+
+  // what publishing every advert would cost: a state message per reported copy
+  uint64_t naiveBytes = 0, adverts = 0;
+  std::vector<uint8_t> packet;
+  const auto start = std::chrono::steady_clock::now();
+  const uint32_t endMs = minutes * 60000;
+  for(uint32_t now = 0; now < endMs; now += FLUSH_MS) {
+    for(unsigned i = 0; i < nodes; ++i) {
+      // adverts of this node within the flush period
+      for(uint32_t t = (now / ADVERT_MS) * ADVERT_MS + phase[i]; t < now + FLUSH_MS; t += ADVERT_MS) {
+        if(t < now) continue;
+        if(t % POLL_MS < ADVERT_MS) { // a new sensor reading: temperature drifts, humidity changes now and then
+          readings[i].temperature += int(rnd() % 3) - 1;
+          if(rnd() % 4 == 0) readings[i].humidity += int(rnd() % 11) - 5;
+        }
+        readings[i].timeMs = t;
+        for(unsigned c = 0; c < CHANNELS; ++c) {
+          pub.update(readings[i]);
+          packet.clear();
+          mqtt::appendPublish(packet, "wnode/" + MqttPublisher::macString(readings[i].mac) + "/state",
+            MqttPublisher::statePayload(readings[i]), 1, false, 1);
+          naiveBytes += packet.size();
+          ++adverts;
+        }
+      }
+    }
+    pub.flush(now);
+    if(!pub.poll()) {
+      fprintf(stderr, "link lost\n");
+      return 1;
+    }
+  }
+  const double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const double simS = endMs / 1000.0;
+  const PublisherStats& st = pub.stats();
+
+  printf("%u nodes, %u min: %llu adverts (%.0f/s)\n", nodes, minutes, (unsigned long long)adverts, adverts / simS);
+  printf("published: %.1f msg/s, %.0f bytes/s (%llu discovery, %llu flushes limited)\n",
+    st.messages / simS, st.bytes / simS, (unsigned long long)st.discovery, (unsigned long long)st.limited);
+  printf("every advert: %.1f msg/s, %.0f bytes/s\n", adverts / simS, naiveBytes / simS);
+  printf("publisher: %.0f adverts/s wall time (naive encoding included)\n", adverts / wallS);
+  return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "mqtt_publisher.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using wnode::Reading;
+
+static const char* const batteryLevels[] = {"high", "medium-high", "medium-low", "low"};
+
+// 0.1 units as a decimal
+static std::string tenths(const int v) {
+  char s[16];
+  snprintf(s, sizeof(s), "%s%d.%d", v < 0? "-" : "", abs(v) / 10, abs(v) % 10);
+  return s;
+}
+
+std::string MqttPublisher::macString(const uint64_t mac) {
+  char s[16];
+  snprintf(s, sizeof(s), "%012llx", (unsigned long long)(mac & 0xFFFFFFFFFFFFULL));
+  return s;
+}
+
+std::string MqttPublisher::statePayload(const Reading& r) {
+  std::string s = "{\"temperature\":" + tenths(r.temperature);
+  if(r.humidity != wnode::NO_VALUE) s += ",\"humidity\":" + tenths(r.humidity);
+  if(r.fields & Reading::HAS_PRESSURE) s += ",\"pressure\":" + tenths(r.pressure);
+  if(r.fields & Reading::HAS_VCC) {
+    char v[16];
+    snprintf(v, sizeof(v), "%u.%03u", r.vccMv / 1000, r.vccMv % 1000);
+    s += ",\"vcc\":" + std::string(v);
+  }
+  s += ",\"battery\":\"" + std::string(batteryLevels[r.status & 0x3]) + "\"";
+  s += (r.status & 0x4)? ",\"sensor_fail\":true}" : ",\"sensor_fail\":false}";
+  return s;
+}
+
+static bool sameValues(const Reading& a, const Reading& b) {
+  return a.temperature == b.temperature && a.humidity == b.humidity && a.status == b.status &&
+    a.pressure == b.pressure && a.vccMv == b.vccMv &&
+    (a.fields & ~Reading::HAS_TELEMETRY) == (b.fields & ~Reading::HAS_TELEMETRY);
+}
+
+// telemetry isn't published, it changes with every window and would defeat coalescing
+void MqttPublisher::update(const Reading& r) {
+  ++st.updates;
+  Node& n = nodes[r.mac];
+  n.latest.merge(r);
+  n.latest.mac = r.mac;
+  if(r.fields & Reading::HAS_DATA) n.fresh = true;
+}
+
+bool MqttPublisher::due(const Node& n, const uint32_t nowMs) const {
+  if(!n.fresh) return false;
+  return !n.everPublished || !sameValues(n.latest, n.published) || nowMs - n.publishedMs >= cfg.maxIntervalMs;
+}
+
+// discovery configs of the values the node has + the state
+size_t MqttPublisher::messagesFor(const Node& n) const {
+  if(n.discovered) return 1;
+  return 2 + (n.latest.humidity != wnode::NO_VALUE) + !!(n.latest.fields & Reading::HAS_PRESSURE) + !!(n.latest.fields & Reading::HAS_VCC);
+}
+
+void MqttPublisher::append(const std::string& topic, const std::string& payload, const bool retain) {
+  uint16_t id = 0;
+  if(cfg.qos) {
+    do id = ++lastPacketId; while(id == 0 || unacked.count(id));
+    unacked.insert(id);
+    txIds.push_back(id);
+  }
+  mqtt::appendPublish(tx, topic, payload, cfg.qos, retain, id);
+  ++txMessages;
+}
+
+void MqttPublisher::appendDiscovery(const Node& n) {
+  const std::string mac = macString(n.latest.mac);
+  const std::string id = "wnode_" + mac;
+  const std::string device = ",\"state_topic\":\"" + cfg.topicPrefix + "/" + mac + "/state\"" +
+    ",\"device\":{\"identifiers\":[\"" + id + "\"],\"name\":\"wNode " + mac + "\",\"manufacturer\":\"Weather Node\"}}";
+  auto sensor = [&](const char* value, const char* deviceClass, const char* unit) {
+    append(cfg.discoveryPrefix + "/sensor/" + id + "/" + value + "/config",
+      std::string("{\"name\":\"wNode ") + mac + " " + value + "\",\"unique_id\":\"" + id + "_" + value + "\"" +
+      ",\"device_class\":\"" + deviceClass + "\",\"unit_of_measurement\":\"" + unit + "\"" +
+      ",\"value_template\":\"{{ value_json." + value + " }}\"" + device,
+      true);
+  };
+  sensor("temperature", "temperature", "\xC2\xB0" "C");
+  if(n.latest.humidity != wnode::NO_VALUE) sensor("humidity", "humidity", "%");
+  if(n.latest.fields & Reading::HAS_PRESSURE) sensor("pressure", "pressure", "hPa");
+  if(n.latest.fields & Reading::HAS_VCC) sensor("vcc", "voltage", "V");
+}
+
+size_t MqttPublisher::flush(const uint32_t nowMs) {
+  tx.clear();
+  txIds.clear();
+  txMessages = 0;
+  if(nodes.empty()) return 0;
+  std::vector<std::pair<Node*, bool>> sent; // node, discovery sent
+
+  size_t states = 0;
+  auto it = nodes.lower_bound(cursor);
+  for(size_t i = 0; i < nodes.size(); ++i, ++it) {
+    if(it == nodes.end()) it = nodes.begin();
+    Node& n = it->second;
+    if(!(n.latest.fields & Reading::HAS_DATA) || !due(n, nowMs)) continue;
+    // a node that needs more messages than maxInFlight still goes once nothing is in flight
+    if(states >= cfg.maxPerFlush || (cfg.qos && !unacked.empty() && unacked.size() + messagesFor(n) > cfg.maxInFlight)) {
+      ++st.limited;
+      cursor = it->first;
+      break;
+    }
+    if(!n.discovered) appendDiscovery(n);
+    append(cfg.topicPrefix + "/" + macString(n.latest.mac) + "/state", statePayload(n.latest), false);
+    sent.push_back({&n, !n.discovered});
+    ++states;
+  }
+
+  if(tx.empty()) return 0;
+  if(!link.send(tx.data(), tx.size())) {
+    for(const uint16_t id : txIds) unacked.erase(id);
+    return 0;
+  }
+  for(const auto& s : sent) {
+    Node& n = *s.first;
+    if(s.second) {
+      st.discovery += messagesFor(n) - 1;
+      n.discovered = true;
+    }
+    n.published = n.latest;
+    n.publishedMs = nowMs;
+    n.everPublished = true;
+    n.fresh = false;
+  }
+  st.messages += txMessages;
+  st.bytes += tx.size();
+  return txMessages;
+}
+
+bool MqttPublisher::poll() {
+  if(!link.receive(rx)) return false;
+  size_t used = 0;
+  mqtt::Packet p;
+  int n;
+  while((n = mqtt::parse(rx.data() + used, rx.size() - used, p)) > 0) {
+    if(p.type == mqtt::PUBACK && p.bodyLen >= 2 && unacked.erase((p.body[0] << 8) | p.body[1])) ++st.acked;
+    used += n;
+  }
+  rx.erase(rx.begin(), rx.begin() + used);
+  return n == 0; // a malformed packet breaks the stream
+}
@@ -0,0 +1,88 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * MQTT / Home Assistant publisher.
+ * Readings are coalesced per node, a node's state is published when its values change or, while the node is
+ * still heard, once per maxIntervalMs. A flush sends all due nodes in one write, at most maxPerFlush states,
+ * and with QoS 1 no more than maxInFlight unacknowledged publishes; the rest waits for the next flush,
+ * which starts where this one stopped. Home Assistant discovery configs (retained) go once per node.
+ */
+
+#ifndef GATEWAY_MQTT_PUBLISHER_H
+#define GATEWAY_MQTT_PUBLISHER_H
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "mqtt.h"
+#include "wnode_scan.h"
+
+struct PublisherConfig {
+  std::string topicPrefix = "wnode";                // state: <prefix>/<mac>/state
+  std::string discoveryPrefix = "homeassistant";    // <prefix>/sensor/wnode_<mac>/<value>/config
+  uint32_t maxIntervalMs = 300000;  // republish unchanged values of a live node
+  uint8_t qos = 1;                  // 0 or 1
+  uint16_t maxInFlight = 32;        // unacknowledged QoS 1 publishes
+  uint16_t maxPerFlush = 64;        // node states per flush
+};
+
+struct PublisherStats {
+  uint64_t updates = 0;
+  uint64_t messages = 0;    // discovery included
+  uint64_t discovery = 0;
+  uint64_t bytes = 0;       // MQTT packets as sent
+  uint64_t acked = 0;
+  uint64_t limited = 0;     // flushes stopped by maxPerFlush or maxInFlight
+};
+
+class MqttPublisher {
+public:
+  explicit MqttPublisher(mqtt::Link& link, const PublisherConfig& cfg = PublisherConfig()) : link(link), cfg(cfg) {}
+
+  void update(const wnode::Reading& r);
+  // publishes what's due in a single send, returns the number of messages; 0 if the link is lost
+  size_t flush(uint32_t nowMs);
+  // takes acks from the broker, false if the link is lost
+  bool poll();
+
+  size_t inFlight() const { return unacked.size(); }
+  const PublisherStats& stats() const { return st; }
+
+  static std::string macString(uint64_t mac);
+  static std::string statePayload(const wnode::Reading& r);
+
+private:
+  struct Node {
+    wnode::Reading latest;
+    wnode::Reading published;
+    uint32_t publishedMs = 0;
+    bool everPublished = false;
+    bool fresh = false;       // updated since the last publish
+    bool discovered = false;
+  };
+
+  bool due(const Node& n, uint32_t nowMs) const;
+  void appendDiscovery(const Node& n);
+  void append(const std::string& topic, const std::string& payload, bool retain);
+  size_t messagesFor(const Node& n) const;
+
+  mqtt::Link& link;
+  const PublisherConfig cfg;
+  PublisherStats st;
+  std::map<uint64_t, Node> nodes;   // by MAC
+  uint64_t cursor = 0;              // MAC the next flush starts from
+  std::set<uint16_t> unacked;
+  uint16_t lastPacketId = 0;
+  std::vector<uint8_t> tx, rx;
+  std::vector<uint16_t> txIds;      // packet ids of this flush
+  size_t txMessages = 0;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * MQTT publisher against the fake broker: packet encoding, coalescing, max interval, discovery,
+ * in-flight and per-flush limits, lost link
+ */
+
+#include <stdio.h>
+#include "mqtt_publisher.h"
+#include "fake_broker.h"
+
+using wnode::Reading;
+
+static unsigned fails = 0;
+#define CHECK(cond) do { if(!(cond)) { ++fails; printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while(0)
+
+static Reading data(const uint64_t mac, const int16_t temperature, const int16_t humidity = wnode::NO_VALUE) {
+  Reading r;
+  r.mac = mac;
+  r.fields = Reading::HAS_DATA;
+  r.temperature = temperature;
+  r.humidity = humidity;
+  return r;
+}
+
+static size_t countTopic(const FakeBroker& b, const std::string& topic) {
+  size_t n = 0;
+  for(const auto& m : b.messages) n += m.topic == topic;
+  return n;
+}
+
+static void packets() {
+  std::vector<uint8_t> buf;
+  const std::string payload(200, 'x'); // remaining length takes 2 bytes
+  mqtt::appendPublish(buf, "a/b", payload, 1, true, 0x1234);
+  mqtt::Packet p;
+  mqtt::Publish pub;
+  CHECK(buf.size() == 1 + 2 + 2 + 3 + 2 + 200);
+  CHECK(mqtt::parse(buf.data(), buf.size() - 1, p) == 0);
+  CHECK(mqtt::parse(buf.data(), buf.size(), p) == int(buf.size()));
+  CHECK(mqtt::parsePublish(p, pub));
+  CHECK(pub.topic == "a/b" && pub.payload == payload && pub.qos == 1 && pub.retain && pub.packetId == 0x1234);
+
+  buf.clear();
+  mqtt::appendConnect(buf, "gw", 60);
+  CHECK(mqtt::parse(buf.data(), buf.size(), p) == int(buf.size()) && p.type == mqtt::CONNECT && p.bodyLen == 14);
+}
+
+static void payload() {
+  Reading r = data(0xA1B2C3D4E5F6ULL, -5, 455);
+  r.fields |= Reading::HAS_VCC;
+  r.vccMv = 2950;
+  r.status = 0x5;
+  CHECK(MqttPublisher::macString(r.mac) == "a1b2c3d4e5f6");
+  CHECK(MqttPublisher::statePayload(r) ==
+    "{\"temperature\":-0.5,\"humidity\":45.5,\"vcc\":2.950,\"battery\":\"medium-high\",\"sensor_fail\":true}");
+}
+
+static void coalescing() {
+  FakeBroker broker;
+  PublisherConfig cfg;
+  cfg.maxIntervalMs = 60000;
+  MqttPublisher pub(broker, cfg);
+  const std::string state = "wnode/0000000000aa/state";
+
+  // the first flush: discovery (temperature, humidity) + the latest state, all in one send
+  pub.update(data(0xAA, 200, 500));
+  pub.update(data(0xAA, 201, 500));
+  CHECK(pub.flush(0) == 3);
+  CHECK(broker.sends == 1 && broker.malformed == 0);
+  CHECK(broker.retained.size() == 2);
+  CHECK(broker.retained.count("homeassistant/sensor/wnode_0000000000aa/temperature/config"));
+  CHECK(broker.retained.count("homeassistant/sensor/wnode_0000000000aa/humidity/config"));
+  CHECK(countTopic(broker, state) == 1 && broker.messages.back().payload.find("\"temperature\":20.1") != std::string::npos);
+  CHECK(!broker.messages.back().retain && broker.messages.back().qos == 1);
+  CHECK(pub.poll() && pub.inFlight() == 0 && pub.stats().acked == 3);
+
+  // the same values (as with every advert between polls) aren't published until the max interval
+  pub.update(data(0xAA, 201, 500));
+  CHECK(pub.flush(1000) == 0);
+  pub.update(data(0xAA, 201, 500));
+  CHECK(pub.flush(60000) == 1);
+  // a node that's not heard anymore isn't republished
+  CHECK(pub.flush(200000) == 0);
+
+  // a change goes right away, discovery isn't repeated
+  pub.update(data(0xAA, 202, 500));
+  CHECK(pub.flush(200001) == 1);
+  CHECK(countTopic(broker, state) == 3 && broker.published == 5);
+
+  // telemetry doesn't make a node due
+  Reading t;
+  t.mac = 0xAA;
+  t.fields = Reading::HAS_TELEMETRY;
+  t.telemetry.wakeups = 64;
+  pub.update(t);
+  CHECK(pub.flush(200002) == 0);
+  // and a telemetry-only node isn't published
+  t.mac = 0xBB;
+  pub.update(t);
+  CHECK(pub.flush(200003) == 0);
+  CHECK(pub.stats().messages == 5 && pub.stats().discovery == 2 && pub.stats().bytes == broker.bytes);
+}
+
+static void limits() {
+  FakeBroker broker;
+  broker.holdAcks = true;
+  PublisherConfig cfg;
+  cfg.maxInFlight = 4;
+  MqttPublisher pub(broker, cfg);
+
+  // 4 nodes need 2 messages each: 2 go, then nothing until acked
+  for(uint64_t mac = 1; mac <= 4; ++mac) pub.update(data(mac, 100));
+  CHECK(pub.flush(0) == 4);
+  CHECK(pub.inFlight() == 4);
+  CHECK(pub.poll() && pub.flush(1) == 0);
+  broker.holdAcks = false;
+  CHECK(pub.poll() && pub.inFlight() == 0);
+  CHECK(pub.flush(2) == 4);
+  CHECK(countTopic(broker, "wnode/000000000004/state") == 1);
+  CHECK(pub.stats().limited == 2);
+
+  // per-flush limit, the next flush continues where the last one stopped
+  FakeBroker broker2;
+  cfg.qos = 0;
+  cfg.maxPerFlush = 3;
+  MqttPublisher pub0(broker2, cfg);
+  for(uint64_t mac = 1; mac <= 4; ++mac) pub0.update(data(mac, 100));
+  CHECK(pub0.flush(0) == 6 && pub0.inFlight() == 0);
+  for(uint64_t mac = 1; mac <= 4; ++mac) pub0.update(data(mac, 101));
+  CHECK(pub0.flush(1) == 2 + 2); // node 4: discovery + state, then 1 and 2
+  CHECK(broker2.messages.back().topic == "wnode/000000000002/state");
+  CHECK(pub0.flush(2) == 1);
+  CHECK(broker2.messages.back().topic == "wnode/000000000003/state");
+  CHECK(broker2.messages.back().qos == 0);
+}
+
+static void lostLink() {
+  FakeBroker broker;
+  MqttPublisher pub(broker);
+  pub.update(data(0xAA, 200));
+  broker.connected = false;
+  CHECK(pub.flush(0) == 0 && pub.inFlight() == 0);
+  CHECK(!pub.poll());
+  // everything goes once the link is back
+  broker.connected = true;
+  CHECK(pub.flush(1) == 2);
+}
+
+int main()
+{
+  packets();
+  payload();
+  coalescing();
+  limits();
+  lostLink();
+  printf("mqtt_publisher_test: %s\n", fails? "FAIL" : "OK");
+  return fails? 1 : 0;
+}
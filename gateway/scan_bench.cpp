@@ -0,0 +1,44 @@
+/*
+ * Scan scheduler against the drift simulator: hit rate vs listening time, calibrated and free-running RTC2
+ *
+ * scan_bench [nodes] [hours]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "scan_sim.h"
+
+static void row(const char* name, const SimConfig& cfg) {
+  const SimResult r = simulate(cfg);
+  printf("%-34s %6u %7.3f%% %8.3f%%\n", name, cfg.schedule.guardUs, 100 * r.hitRate(), 100 * r.listening);
+}
+
+int main(int argc, char** argv)
+{
+  SimConfig cfg;
+  if(argc > 1) cfg.nodes = atoi(argv[1]);
+  if(argc > 2) cfg.hours = atof(argv[2]);
+  printf("%u nodes, %.1f h, period %u ms, RCOSC32K +-%.0f ppm static +-%.0f ppm daily, %.0f%% lost on air\n",
+    cfg.nodes, cfg.hours, cfg.periodMs, cfg.rcErrorPpm, cfg.thermalPpm, cfg.lossRate * 100);
+  printf("%-34s %6s %8s %9s\n", "", "guard", "hit", "listening");
+
+  SimConfig c = cfg;
+  c.continuous = true;
+  row("continuous scan", c);
+
+  for(const uint32_t guard : {250, 500, 1000, 2000, 4000}) {
+    c = cfg;
+    c.schedule.guardUs = guard;
+    row("calibrated, learned period", c);
+  }
+  c = cfg;
+  c.schedule.learnPeriod = false;
+  row("calibrated, advertised period", c);
+
+  c = cfg;
+  c.calibrated = false;
+  row("free-running, learned period", c);
+  c.schedule.learnPeriod = false;
+  row("free-running, advertised period", c);
+  return 0;
+}
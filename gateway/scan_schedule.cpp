@@ -0,0 +1,76 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "scan_schedule.h"
+#include <math.h>
+
+// measured periods are averaged over that many arrivals, then follow the drift
+static const uint32_t PERIOD_AVERAGE = 8;
+// longer gaps may be counted in a wrong number of slots, they only move the phase
+static const uint64_t MAX_MEASURED_SLOTS = 64;
+
+void ScanSchedule::arrival(const uint64_t node, const uint64_t timeUs, const uint16_t periodMs) {
+  const auto it = nodes.find(node);
+  if(it == nodes.end()) {
+    Node n;
+    n.lastUs = timeUs;
+    n.periodUs = periodMs * 1000.0;
+    nodes.emplace(node, n);
+    return;
+  }
+  Node& n = it->second;
+  if(timeUs < n.lastUs + cfg.minPeriodUs) return;
+  const double gap = double(timeUs - n.lastUs);
+  n.lastUs = timeUs;
+  if(!n.periodUs) {
+    n.periodUs = gap;
+    return;
+  }
+  if(!cfg.learnPeriod) return;
+  const uint64_t slots = llround(gap / n.periodUs);
+  if(slots < 1 || slots > MAX_MEASURED_SLOTS) return;
+  // a gap over several slots is as precise as that many single ones
+  const double measured = gap / slots;
+  const uint32_t averaged = n.estimates < PERIOD_AVERAGE? n.estimates + 1 : PERIOD_AVERAGE;
+  const double weight = slots >= averaged? 1. : double(slots) / averaged;
+  n.periodUs += (measured - n.periodUs) * weight;
+  ++n.estimates;
+}
+
+bool ScanSchedule::window(const Node& n, const uint64_t nowUs, ScanWindow& w) const {
+  if(!n.periodUs) return false;
+  const uint64_t elapsed = nowUs > n.lastUs? nowUs - n.lastUs : 0;
+  for(uint64_t k = elapsed > n.periodUs? uint64_t(elapsed / n.periodUs) : 1; k <= cfg.maxMissedSlots; ++k) {
+    const double center = n.lastUs + k * n.periodUs;
+    const double half = cfg.guardUs + k * n.periodUs * cfg.driftPpm / 1e6;
+    w.startUs = uint64_t(center - half);
+    w.endUs = uint64_t(center + half);
+    if(w.endUs > nowUs) return true;
+  }
+  return false;
+}
+
+bool ScanSchedule::window(const uint64_t node, const uint64_t nowUs, ScanWindow& w) const {
+  const auto it = nodes.find(node);
+  return it != nodes.end() && window(it->second, nowUs, w);
+}
+
+bool ScanSchedule::next(const uint64_t nowUs, ScanWindow& w) const {
+  bool found = false;
+  for(const auto& it : nodes) {
+    ScanWindow nw;
+    if(!window(it.second, nowUs, nw)) return false;
+    if(!found || nw.startUs < w.startUs || (nw.startUs == w.startUs && nw.endUs < w.endUs)) w = nw;
+    found = true;
+  }
+  return found;
+}
+
+double ScanSchedule::periodUs(const uint64_t node) const {
+  const auto it = nodes.find(node);
+  return it == nodes.end()? 0 : it->second.periodUs;
+}
@@ -0,0 +1,68 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * Scan scheduler: learns each node's TX schedule so the receiver listens only in windows around expected adverts.
+ * A node sends at the start of every period (WNODE_TLV_SCHEDULE, calibrated RTC2 on wnode1), so the last arrival
+ * is the phase and the advertised period is the first estimate; arrivals refine it (RCOSC32K error left after
+ * calibration, drift since). A window is +-(guardUs + driftPpm of the time since the last arrival) around the
+ * prediction. A node that doesn't advertise its period gets it from the first gap between arrivals (a multiple of
+ * the real one if slots were missed in between, windows still hit). A node not heard for maxMissedSlots periods
+ * is lost: the receiver scans continuously until it's back.
+ */
+
+#ifndef GATEWAY_SCAN_SCHEDULE_H
+#define GATEWAY_SCAN_SCHEDULE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+
+struct ScheduleConfig {
+  uint32_t guardUs = 2000;          // TX latency spread after wakeup, receiver timing
+  uint32_t driftPpm = 500;          // how far a period may wander between arrivals
+  uint32_t maxMissedSlots = 4;
+  uint32_t minPeriodUs = 100000;    // arrivals closer than that are copies on other channels
+  bool learnPeriod = true;          // false - trust the advertised period, only the phase follows arrivals
+};
+
+struct ScanWindow {
+  uint64_t startUs;
+  uint64_t endUs;
+};
+
+class ScanSchedule {
+public:
+  explicit ScanSchedule(const ScheduleConfig& cfg = ScheduleConfig()) : cfg(cfg) {}
+
+  // an advert of the node received; periodMs - advertised period, 0 if the node doesn't send it
+  void arrival(uint64_t node, uint64_t timeUs, uint16_t periodMs);
+  // the node's next window that ends after nowUs; false - no schedule (unknown, period not learned yet or lost):
+  // scan continuously for it
+  bool window(uint64_t node, uint64_t nowUs, ScanWindow& w) const;
+  // the earliest window of all nodes ending after nowUs; false - some node needs a continuous scan or there are none
+  bool next(uint64_t nowUs, ScanWindow& w) const;
+  // learned period, 0 if unknown
+  double periodUs(uint64_t node) const;
+
+  void forget(uint64_t node) { nodes.erase(node); }
+  size_t size() const { return nodes.size(); }
+
+private:
+  struct Node {
+    uint64_t lastUs = 0;    // last arrival, the phase
+    double periodUs = 0;    // 0 - not known yet
+    uint32_t estimates = 0; // periods measured from arrivals
+  };
+
+  bool window(const Node& n, uint64_t nowUs, ScanWindow& w) const;
+
+  const ScheduleConfig cfg;
+  std::map<uint64_t, Node> nodes;
+};
+
+#endif
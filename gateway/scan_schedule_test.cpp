@@ -0,0 +1,98 @@
+/*
+ * Scan scheduler: windows from the advertised period and arrivals, learned period, copies on other channels,
+ * lost nodes; drift simulator with calibrated and free-running nodes
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "scan_schedule.h"
+#include "scan_sim.h"
+
+static unsigned fails = 0;
+#define CHECK(cond) do { if(!(cond)) { ++fails; printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while(0)
+
+static const uint64_t S = 1000000;
+
+static void windows() {
+  ScheduleConfig cfg;
+  cfg.guardUs = 1000;
+  cfg.driftPpm = 200;
+  cfg.maxMissedSlots = 3;
+  ScanSchedule sch(cfg);
+  ScanWindow w;
+  CHECK(!sch.window(1, 0, w) && !sch.next(0, w));
+
+  // advertised period, phase from the arrival: +-(1ms + 200ppm of 1.75s)
+  sch.arrival(1, 10 * S, 1750);
+  CHECK(sch.window(1, 10 * S, w) && w.startUs == 11750000 - 1350 && w.endUs == 11750000 + 1350);
+  CHECK(sch.next(10 * S, w) && w.startUs == 11750000 - 1350);
+  // the first slot missed: the next one, wider
+  CHECK(sch.window(1, 11760000, w) && w.startUs == 13500000 - 1700 && w.endUs == 13500000 + 1700);
+  // lost after 3 missed slots: continuous scan
+  CHECK(sch.window(1, 15250000, w));
+  CHECK(!sch.window(1, 15253000, w) && !sch.next(15253000, w));
+
+  // a copy on another channel doesn't move the phase
+  sch.arrival(1, 10 * S + 1500, 1750);
+  CHECK(sch.window(1, 10 * S, w) && w.startUs == 11750000 - 1350);
+
+  // the node sends every 1751ms: the period is learned, also over missed slots
+  uint64_t t = 10 * S;
+  for(int i = 0; i < 20; ++i) {
+    t += (i % 4 == 3? 2 : 1) * 1751000 + (i % 2? 30 : -30);
+    sch.arrival(1, t, 1750);
+  }
+  CHECK(fabs(sch.periodUs(1) - 1751000) < 20);
+  CHECK(sch.window(1, t, w) && w.startUs < t + 1751000 && w.endUs > t + 1751000);
+
+  // not advertised: from the first gap
+  sch.arrival(2, 0, 0);
+  CHECK(!sch.window(2, 0, w) && !sch.next(0, w));
+  sch.arrival(2, 2 * S, 0);
+  CHECK(sch.periodUs(2) == 2 * S && sch.window(2, 2 * S, w) && w.startUs < 4 * S && w.endUs > 4 * S);
+
+  // the earliest of the nodes
+  CHECK(sch.next(2 * S, w) && w.startUs < 4 * S && w.endUs > 4 * S);
+  sch.forget(2);
+  CHECK(sch.size() == 1 && sch.next(t, w) && w.startUs > t);
+}
+
+static void drift() {
+  SimConfig cfg;
+  cfg.nodes = 20;
+  cfg.hours = 2;
+  cfg.calibrateEvery = 1024; // a calibration within the run
+
+  // calibrated nodes: nearly all adverts in a small share of the time
+  SimResult r = simulate(cfg);
+  CHECK(r.sent > 20 * 4000 && r.lost > 0);
+  CHECK(r.hitRate() > 0.999);
+  CHECK(r.listening < 0.05);
+
+  // the reference
+  SimConfig c = cfg;
+  c.continuous = true;
+  r = simulate(c);
+  CHECK(r.hitRate() == 1 && r.listening > 0.99);
+
+  // free-running RTC2: the advertised period is several % off, only a learned one keeps the windows
+  c = cfg;
+  c.calibrated = false;
+  r = simulate(c);
+  CHECK(r.hitRate() > 0.999 && r.listening < 0.05);
+  c.schedule.learnPeriod = false;
+  r = simulate(c);
+  CHECK(r.hitRate() < 0.5 && r.listening > 0.5); // nodes near 0 ppm keep their windows
+  // while calibrated nodes can be trusted
+  c.calibrated = true;
+  r = simulate(c);
+  CHECK(r.hitRate() > 0.999 && r.listening < 0.05);
+}
+
+int main()
+{
+  windows();
+  drift();
+  printf("scan_schedule_test: %s\n", fails? "FAIL" : "OK");
+  return fails? 1 : 0;
+}
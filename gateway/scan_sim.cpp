@@ -0,0 +1,114 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "scan_sim.h"
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+static const double RTC2_HZ = 32768;
+static const double DAY_US = 86400e6;
+
+typedef std::pair<uint64_t, uint64_t> Interval;
+
+namespace {
+
+// RCOSC32K with its error, RTC2 compare value as the firmware sets it
+struct NodeModel {
+  double errorPpm;
+  double thermalPhase;
+  uint32_t ticks;       // RTC2 ticks per wake period
+  double wakeUs;        // true time of the current wakeup
+  uint32_t wakeups = 0;
+
+  double ppm(const SimConfig& cfg, const double t) const {
+    return errorPpm + cfg.thermalPpm * sin(2 * M_PI * t / DAY_US + thermalPhase);
+  }
+};
+
+}
+
+// receiver side of one node: windows from the schedule, adverts in them are received
+static void receive(const SimConfig& cfg, ScanSchedule& schedule, const uint64_t id, const std::vector<std::pair<uint64_t, bool>>& adverts,
+  std::vector<Interval>& listened, SimResult& res)
+{
+  uint64_t now = 0;
+  for(const auto& adv : adverts) {
+    const uint64_t t = adv.first;
+    const bool lost = adv.second;
+    for(;;) {
+      ScanWindow w;
+      if(cfg.continuous || !schedule.window(id, now, w)) {
+        listened.emplace_back(now, t);
+        now = t;
+        if(!lost) {
+          ++res.received;
+          schedule.arrival(id, t, cfg.periodMs);
+        }
+        break;
+      }
+      if(t < w.startUs) break;  // not listening
+      if(t >= w.endUs || lost) {
+        listened.emplace_back(w.startUs, w.endUs);
+        now = w.endUs;
+        if(t >= w.endUs) continue;
+        break;
+      }
+      listened.emplace_back(w.startUs, t); // the window is closed once the advert is in
+      now = t;
+      ++res.received;
+      schedule.arrival(id, t, cfg.periodMs);
+      break;
+    }
+  }
+}
+
+SimResult simulate(const SimConfig& cfg) {
+  std::mt19937 rng(cfg.seed);
+  std::uniform_real_distribution<double> uni(-1, 1);
+  std::uniform_real_distribution<double> unit(0, 1);
+  const double endUs = cfg.hours * 3600e6;
+  const double nominalTicks = cfg.periodMs * RTC2_HZ / 1000;
+  ScanSchedule schedule(cfg.schedule);
+  SimResult res;
+  std::vector<Interval> listened;
+  std::vector<std::pair<uint64_t, bool>> adverts;
+
+  for(uint64_t id = 0; id < cfg.nodes; ++id) {
+    NodeModel n;
+    n.errorPpm = uni(rng) * cfg.rcErrorPpm;
+    n.thermalPhase = unit(rng) * 2 * M_PI;
+    n.ticks = uint32_t(nominalTicks);
+    n.wakeUs = unit(rng) * cfg.periodMs * 1000; // booted at some point
+
+    adverts.clear();
+    for(; n.wakeUs < endUs; ++n.wakeups) {
+      const double ppm = n.ppm(cfg, n.wakeUs);
+      if(cfg.calibrated && n.wakeups % cfg.calibrateEvery == 0)
+        n.ticks = uint32_t(lround(nominalTicks * (1 + (ppm + uni(rng) * cfg.calErrorPpm) / 1e6)));
+      const double tx = n.wakeUs + uni(rng) * cfg.txJitterUs;
+      adverts.emplace_back(uint64_t(tx > 0? tx : 0), unit(rng) < cfg.lossRate);
+      n.wakeUs += n.ticks / (RTC2_HZ * (1 + ppm / 1e6)) * 1e6;
+    }
+    res.sent += adverts.size();
+    for(const auto& a : adverts) res.lost += a.second;
+    receive(cfg, schedule, id, adverts, listened, res);
+  }
+
+  // radio time: windows of all nodes merged
+  std::sort(listened.begin(), listened.end());
+  uint64_t total = 0, end = 0;
+  for(const Interval& i : listened) {
+    const uint64_t from = std::max(i.first, end);
+    if(i.second > from) total += i.second - from;
+    end = std::max(end, i.second);
+  }
+  res.listening = total / endUs;
+  return res;
+}
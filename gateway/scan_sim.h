@@ -0,0 +1,47 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * Drift simulator for the scan scheduler: nodes wake on RTC2 from RCOSC32K (static error + daily temperature
+ * swing), either calibrated against XOSC16M every calibrateEvery wakeups as wnode1 does, or with the nominal
+ * compare value; they send at the start of each period with some jitter, a share of adverts is lost on air.
+ * The receiver listens only in ScanSchedule windows, the result is the hit rate against the time spent listening.
+ */
+
+#ifndef GATEWAY_SCAN_SIM_H
+#define GATEWAY_SCAN_SIM_H
+
+#include <stdint.h>
+#include "scan_schedule.h"
+
+struct SimConfig {
+  uint32_t nodes = 50;
+  double hours = 6;
+  uint16_t periodMs = 1750;       // WAKE_PERIOD_MS
+  bool calibrated = true;
+  uint32_t calibrateEvery = 2048; // wakeups
+  double rcErrorPpm = 30000;      // static RCOSC32K error, uniform +-
+  double thermalPpm = 3000;       // daily swing, +-
+  double calErrorPpm = 50;        // RTC2 vs timer0 count, uniform +-
+  double txJitterUs = 40;         // wakeup to TX, uniform +-
+  double lossRate = 0.01;         // adverts lost on air
+  bool continuous = false;        // the reference: receiver never stops scanning
+  ScheduleConfig schedule;
+  uint32_t seed = 1;
+};
+
+struct SimResult {
+  uint64_t sent = 0;
+  uint64_t lost = 0;      // on air, not counted against the hit rate
+  uint64_t received = 0;
+  double listening = 0;   // share of time the receiver listens (windows of all nodes merged)
+  double hitRate() const { return sent > lost? double(received) / (sent - lost) : 0; }
+};
+
+SimResult simulate(const SimConfig& cfg);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "tcp_link.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+static const int CONNACK_TIMEOUT_MS = 5000;
+static const uint16_t KEEP_ALIVE_S = 60;
+
+TcpLink::~TcpLink() { close(); }
+
+void TcpLink::close() {
+  if(fd >= 0) ::close(fd);
+  fd = -1;
+}
+
+bool TcpLink::connect(const std::string& host, const uint16_t port, const std::string& clientId) {
+  close();
+  addrinfo hints = {}, *addrs;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  const int err = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addrs);
+  if(err) {
+    fprintf(stderr, "%s: %s\n", host.c_str(), gai_strerror(err));
+    return false;
+  }
+  for(addrinfo* a = addrs; a && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if(fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen)) close();
+  }
+  freeaddrinfo(addrs);
+  if(fd < 0) {
+    fprintf(stderr, "%s:%u: %s\n", host.c_str(), port, strerror(errno));
+    return false;
+  }
+  // a flush is written at once, don't hold it back
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  std::vector<uint8_t> buf;
+  mqtt::appendConnect(buf, clientId, KEEP_ALIVE_S);
+  if(!send(buf.data(), buf.size())) return false;
+  buf.clear();
+  pollfd pfd = {fd, POLLIN, 0};
+  mqtt::Packet p;
+  while(mqtt::parse(buf.data(), buf.size(), p) == 0) {
+    if(poll(&pfd, 1, CONNACK_TIMEOUT_MS) <= 0 || !receive(buf)) {
+      fprintf(stderr, "%s:%u: no CONNACK\n", host.c_str(), port);
+      close();
+      return false;
+    }
+  }
+  if(p.type != mqtt::CONNACK || p.bodyLen < 2 || p.body[1] != 0) {
+    fprintf(stderr, "%s:%u: connection refused\n", host.c_str(), port);
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool TcpLink::send(const uint8_t* data, size_t len) {
+  while(len && fd >= 0) {
+    const ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) close();
+    else {
+      data += n;
+      len -= n;
+    }
+  }
+  return fd >= 0;
+}
+
+bool TcpLink::receive(std::vector<uint8_t>& buf) {
+  uint8_t chunk[4096];
+  while(fd >= 0) {
+    const ssize_t n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+    if(n > 0) buf.insert(buf.end(), chunk, chunk + n);
+    else if(n < 0 && errno == EINTR) continue;
+    else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    else close(); // closed by the broker or an error
+  }
+  return fd >= 0;
+}
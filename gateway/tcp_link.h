@@ -0,0 +1,32 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * MQTT broker connection over TCP (e.g. a local mosquitto), POSIX sockets
+ */
+
+#ifndef GATEWAY_TCP_LINK_H
+#define GATEWAY_TCP_LINK_H
+
+#include <string>
+#include "mqtt.h"
+
+class TcpLink : public mqtt::Link {
+public:
+  ~TcpLink() override;
+  // connects and waits for CONNACK, false on failure (the reason goes to stderr)
+  bool connect(const std::string& host, uint16_t port, const std::string& clientId);
+
+  bool send(const uint8_t* data, size_t len) override;
+  bool receive(std::vector<uint8_t>& buf) override;
+
+private:
+  int fd = -1;
+  void close();
+};
+
+#endif
@@ -0,0 +1,288 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "trace.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace trace {
+
+std::atomic<bool> active{true};
+
+static const char* const STAGE_NAMES[STAGES] = {"report", "decode", "dedup", "aggregate", "store"};
+static const char* const COUNTER_NAMES[COUNTERS] = {"accepted", "duplicates", "crc_failures", "decode_rejects"};
+
+const char* stageName(const stage_t s) { return s < STAGES? STAGE_NAMES[s] : "?"; }
+const char* counterName(const counter_t c) { return c < COUNTERS? COUNTER_NAMES[c] : "?"; }
+
+/* --- clock --- */
+
+typedef std::chrono::steady_clock Clock;
+static const Clock::time_point clockStart = Clock::now();
+static const uint64_t ticksStart = now();
+
+double nsPerTick() {
+  static const double ns = [] {
+    // a few ms are enough for the TSC rate to be within 0.1%
+    while(Clock::now() - clockStart < std::chrono::milliseconds(5))
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const uint64_t ticks = now();
+    const double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - clockStart).count();
+    return elapsed / double(ticks - ticksStart);
+  }();
+  return ns;
+}
+
+/* --- histogram --- */
+
+uint64_t Histogram::lowest(const unsigned b) {
+  if(b < (1u << SUB_BITS)) return b;
+  const unsigned shift = (b >> SUB_BITS) - 1;
+  return uint64_t((1u << SUB_BITS) | (b & ((1u << SUB_BITS) - 1))) << shift;
+}
+
+void Histogram::record(const uint64_t v) {
+  ++counts[bucket(v)];
+  ++count;
+  sum += v;
+  if(v > max) max = v;
+}
+
+void Histogram::merge(const Histogram& h) {
+  for(unsigned b = 0; b < BUCKETS; ++b) counts[b] += h.counts[b];
+  count += h.count;
+  sum += h.sum;
+  if(h.max > max) max = h.max;
+}
+
+uint64_t Histogram::quantile(const double q) const {
+  if(!count) return 0;
+  uint64_t rank = q > 0? uint64_t(q * count + 0.5) : 1;
+  if(rank < 1) rank = 1;
+  uint64_t seen = 0;
+  for(unsigned b = 0; b < BUCKETS; ++b) {
+    seen += counts[b];
+    if(seen >= rank) {
+      const uint64_t upper = b + 1 < BUCKETS? lowest(b + 1) - 1 : max;
+      return upper < max? upper : max;
+    }
+  }
+  return max;
+}
+
+/* --- slots --- */
+
+Slot::Slot() { clear(); }
+
+void Slot::clear() {
+  for(Stage& st : stages) {
+    for(auto& c : st.counts) c.store(0, std::memory_order_relaxed);
+    st.count.store(0, std::memory_order_relaxed);
+    st.sum.store(0, std::memory_order_relaxed);
+    st.max.store(0, std::memory_order_relaxed);
+  }
+  for(Node& n : nodes) {
+    for(auto& c : n.counters) c.store(0, std::memory_order_relaxed);
+    n.lastSeenMs.store(0, std::memory_order_relaxed);
+  }
+  for(auto& c : others.counters) c.store(0, std::memory_order_relaxed);
+  dropped.store(0, std::memory_order_relaxed);
+}
+
+void Slot::addTo(Snapshot& s) const {
+  for(unsigned i = 0; i < STAGES; ++i) {
+    const Stage& st = stages[i];
+    Histogram& h = s.stages[i];
+    for(unsigned b = 0; b < Histogram::BUCKETS; ++b) h.counts[b] += st.counts[b].load(std::memory_order_relaxed);
+    h.count += st.count.load(std::memory_order_relaxed);
+    h.sum += st.sum.load(std::memory_order_relaxed);
+    const uint64_t max = st.max.load(std::memory_order_relaxed);
+    if(max > h.max) h.max = max;
+  }
+  for(const Node& n : nodes) {
+    const uint64_t key = n.key.load(std::memory_order_acquire);
+    if(!key) continue;
+    NodeStats& ns = s.nodes[key - 1];
+    for(unsigned c = 0; c < COUNTERS; ++c) ns.counters[c] += n.counters[c].load(std::memory_order_relaxed);
+    const uint32_t seen = n.lastSeenMs.load(std::memory_order_relaxed);
+    if(seen > ns.lastSeenMs) ns.lastSeenMs = seen;
+  }
+  for(unsigned c = 0; c < COUNTERS; ++c) s.other.counters[c] += others.counters[c].load(std::memory_order_relaxed);
+  s.droppedNodes += dropped.load(std::memory_order_relaxed);
+}
+
+static std::mutex slotsLock;
+static std::vector<Slot*> slots;  // never freed: counts of finished threads stay in the totals
+
+Slot& local() {
+  static thread_local Slot* slot = nullptr;
+  if(!slot) {
+    slot = new Slot();
+    std::lock_guard<std::mutex> lock(slotsLock);
+    slots.push_back(slot);
+  }
+  return *slot;
+}
+
+void snapshot(Snapshot& s) {
+  s = Snapshot();
+  s.nsPerTick = nsPerTick();
+  std::lock_guard<std::mutex> lock(slotsLock);
+  s.threads = uint32_t(slots.size());
+  for(const Slot* slot : slots) slot->addTo(s);
+}
+
+void clear() {
+  std::lock_guard<std::mutex> lock(slotsLock);
+  for(Slot* slot : slots) slot->clear();
+}
+
+/* --- Prometheus text --- */
+
+static void appendf(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void appendf(std::string& out, const char* fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  const int n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if(n > 0) out.append(buf, size_t(n) < sizeof(buf)? size_t(n) : sizeof(buf) - 1);
+}
+
+std::string prometheusText(const Snapshot& s) {
+  static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+  const double sPerTick = s.nsPerTick / 1e9;
+  std::string out;
+  out += "# HELP wnode_gateway_stage_seconds Ingest stage latency (sampled adverts; store per batch)\n";
+  out += "# TYPE wnode_gateway_stage_seconds summary\n";
+  for(unsigned i = 0; i < STAGES; ++i) {
+    const Histogram& h = s.stages[i];
+    const char* name = stageName(stage_t(i));
+    for(const double q : QUANTILES)
+      appendf(out, "wnode_gateway_stage_seconds{stage=\"%s\",quantile=\"%g\"} %.9g\n", name, q, h.quantile(q) * sPerTick);
+    appendf(out, "wnode_gateway_stage_seconds_sum{stage=\"%s\"} %.9g\n", name, h.sum * sPerTick);
+    appendf(out, "wnode_gateway_stage_seconds_count{stage=\"%s\"} %llu\n", name, (unsigned long long)h.count);
+  }
+  out += "# TYPE wnode_gateway_node_adverts_total counter\n";
+  for(const auto& n : s.nodes)
+    appendf(out, "wnode_gateway_node_adverts_total{mac=\"%012llx\"} %llu\n",
+      (unsigned long long)(n.first & 0xFFFFFFFFFFFFULL), (unsigned long long)n.second.adverts());
+  for(unsigned c = 0; c < COUNTERS; ++c) {
+    const char* name = counterName(counter_t(c));
+    appendf(out, "# TYPE wnode_gateway_node_%s_total counter\n", name);
+    for(const auto& n : s.nodes)
+      appendf(out, "wnode_gateway_node_%s_total{mac=\"%012llx\"} %llu\n", name,
+        (unsigned long long)(n.first & 0xFFFFFFFFFFFFULL), (unsigned long long)n.second.counters[c]);
+  }
+  out += "# HELP wnode_gateway_node_last_seen_seconds Time of the last report, scanner clock\n";
+  out += "# TYPE wnode_gateway_node_last_seen_seconds gauge\n";
+  for(const auto& n : s.nodes)
+    appendf(out, "wnode_gateway_node_last_seen_seconds{mac=\"%012llx\"} %.3f\n",
+      (unsigned long long)(n.first & 0xFFFFFFFFFFFFULL), n.second.lastSeenMs / 1000.);
+  for(unsigned c = 0; c < COUNTERS; ++c) {
+    const char* name = counterName(counter_t(c));
+    appendf(out, "# TYPE wnode_gateway_other_%s_total counter\n", name);
+    appendf(out, "wnode_gateway_other_%s_total %llu\n", name, (unsigned long long)s.other.counters[c]);
+  }
+  out += "# TYPE wnode_gateway_trace_threads gauge\n";
+  appendf(out, "wnode_gateway_trace_threads %u\n", s.threads);
+  out += "# TYPE wnode_gateway_trace_dropped_nodes_total counter\n";
+  appendf(out, "wnode_gateway_trace_dropped_nodes_total %llu\n", (unsigned long long)s.droppedNodes);
+  return out;
+}
+
+/* --- binary dump --- */
+
+static const uint8_t MAGIC[4] = {'W', 'N', 'T', 'R'};
+static const uint8_t VERSION = 1;
+
+static void put(std::vector<uint8_t>& out, uint64_t v, const unsigned bytes) {
+  for(unsigned i = 0; i < bytes; ++i, v >>= 8) out.push_back(uint8_t(v));
+}
+
+namespace {
+struct Reader {
+  const uint8_t* p;
+  const uint8_t* const end;
+  bool ok = true;
+  Reader(const uint8_t* p, const uint8_t* end) : p(p), end(end) {}
+  uint64_t get(const unsigned bytes) {
+    if(size_t(end - p) < bytes) {
+      ok = false;
+      return 0;
+    }
+    uint64_t v = 0;
+    for(unsigned i = 0; i < bytes; ++i) v |= uint64_t(p[i]) << (8 * i);
+    p += bytes;
+    return v;
+  }
+};
+}
+
+void writeBinary(const Snapshot& s, std::vector<uint8_t>& out) {
+  out.assign(MAGIC, MAGIC + sizeof(MAGIC));
+  out.push_back(VERSION);
+  uint64_t ns;
+  memcpy(&ns, &s.nsPerTick, sizeof(ns));
+  put(out, ns, 8);
+  put(out, s.threads, 4);
+  put(out, s.droppedNodes, 8);
+  put(out, STAGES, 1);
+  for(const Histogram& h : s.stages) {
+    put(out, h.count, 8);
+    put(out, h.sum, 8);
+    put(out, h.max, 8);
+    uint16_t used = 0;
+    for(const uint64_t c : h.counts) used += c != 0;
+    put(out, used, 2);
+    for(unsigned b = 0; b < Histogram::BUCKETS; ++b) if(h.counts[b]) {
+      put(out, b, 2);
+      put(out, h.counts[b], 8);
+    }
+  }
+  put(out, s.nodes.size(), 4);
+  for(const auto& n : s.nodes) {
+    put(out, n.first, 6);
+    for(const uint64_t c : n.second.counters) put(out, c, 8);
+    put(out, n.second.lastSeenMs, 4);
+  }
+  for(const uint64_t c : s.other.counters) put(out, c, 8);
+}
+
+bool readBinary(const uint8_t* data, const size_t len, Snapshot& s) {
+  s = Snapshot();
+  if(len < sizeof(MAGIC) + 1 || memcmp(data, MAGIC, sizeof(MAGIC)) || data[sizeof(MAGIC)] != VERSION) return false;
+  Reader r(data + sizeof(MAGIC) + 1, data + len);
+  const uint64_t ns = r.get(8);
+  memcpy(&s.nsPerTick, &ns, sizeof(ns));
+  s.threads = uint32_t(r.get(4));
+  s.droppedNodes = r.get(8);
+  if(r.get(1) != STAGES) return false;
+  for(Histogram& h : s.stages) {
+    h.count = r.get(8);
+    h.sum = r.get(8);
+    h.max = r.get(8);
+    for(uint64_t used = r.get(2); used && r.ok; --used) {
+      const uint64_t b = r.get(2);
+      if(b >= Histogram::BUCKETS) return false;
+      h.counts[b] = r.get(8);
+    }
+  }
+  for(uint64_t nodes = r.get(4); nodes && r.ok; --nodes) {
+    NodeStats& n = s.nodes[r.get(6)];
+    for(uint64_t& c : n.counters) c = r.get(8);
+    n.lastSeenMs = uint32_t(r.get(4));
+  }
+  for(uint64_t& c : s.other.counters) c = r.get(8);
+  return r.ok && r.p == r.end;
+}
+
+}
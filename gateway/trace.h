@@ -0,0 +1,199 @@
+/*
+ * Weather Node gateway
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * Ingest tracing: per-stage latency histograms and per-node counters.
+ * Every thread records into its own slot, allocated once on the thread's first record and kept for the process
+ * lifetime; a slot has a single writer, so records are plain relaxed loads and stores (no locks, no atomic RMW,
+ * no allocation). Nodes live in a fixed open-addressing table per slot, nodes past its capacity are only counted;
+ * reports of MACs that aren't nodes (other devices, corrupted addresses) go to one shared entry, as random
+ * addresses of phones alone would fill the table and the exposition.
+ * A snapshot merges all slots (it may run concurrently with the writers) and is exposed as Prometheus text
+ * or a compact binary dump.
+ * Time is in ticks of now(): TSC on x86 (invariant on anything recent), steady_clock ns elsewhere.
+ */
+
+#ifndef GATEWAY_TRACE_H
+#define GATEWAY_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace trace {
+
+enum stage_t : uint8_t {
+  REPORT,     // radio report to the start of ingest: queueing
+  DECODE,
+  DEDUP,
+  AGGREGATE,
+  STORE,      // a coalesced batch to the publisher, per batch
+  STAGES
+};
+
+// one per report: the node's adverts are their sum
+enum counter_t : uint8_t {
+  ACCEPTED,
+  DUPLICATES,     // copies of an advert on other channels
+  CRC_FAILURES,
+  DECODE_REJECTS,
+  COUNTERS
+};
+
+const char* stageName(stage_t s);
+const char* counterName(counter_t c);
+
+inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// ns per now() tick, measured against steady_clock since the start (the first call may wait a few ms)
+double nsPerTick();
+
+// Log-linear buckets like HdrHistogram: values below 2^SUB_BITS are exact, above that 2^SUB_BITS buckets
+// per power of two (<= 1/2^SUB_BITS relative error), values past 2^MAX_BITS go to the last bucket
+struct Histogram {
+  static const unsigned SUB_BITS = 4;
+  static const unsigned MAX_BITS = 40;
+  static const unsigned BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+  uint64_t counts[BUCKETS] = {};
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+
+  static unsigned bucket(uint64_t v) {
+    if(v < (1u << SUB_BITS)) return unsigned(v);
+    const unsigned shift = 63 - __builtin_clzll(v) - SUB_BITS;
+    if(shift > MAX_BITS - SUB_BITS - 1) return BUCKETS - 1;
+    return ((shift + 1) << SUB_BITS) | unsigned((v >> shift) & ((1u << SUB_BITS) - 1));
+  }
+  // the smallest value of the bucket
+  static uint64_t lowest(unsigned b);
+
+  void record(uint64_t v);
+  void merge(const Histogram& h);
+  // value at quantile q (0..1): the upper edge of its bucket, no more than max
+  uint64_t quantile(double q) const;
+};
+
+struct NodeStats {
+  uint64_t counters[COUNTERS] = {};
+  uint32_t lastSeenMs = 0;  // the caller's clock (RawAdvert::timeMs)
+
+  uint64_t adverts() const {
+    uint64_t n = 0;
+    for(const uint64_t c : counters) n += c;
+    return n;
+  }
+};
+
+struct Snapshot {
+  double nsPerTick = 1;
+  uint32_t threads = 0;
+  uint64_t droppedNodes = 0;  // counter records of nodes that didn't fit a slot's table
+  Histogram stages[STAGES];
+  std::map<uint64_t, NodeStats> nodes;  // by MAC
+  NodeStats other;  // reports of MACs that aren't nodes
+};
+
+// one thread's records
+class Slot {
+public:
+  static const size_t NODES = 4096;  // per slot, power of 2
+
+  struct Node {
+    std::atomic<uint64_t> key{0};   // MAC + 1, 0 - free
+    std::atomic<uint64_t> counters[COUNTERS];
+    std::atomic<uint32_t> lastSeenMs{0};
+  };
+
+  Slot();
+  void latency(stage_t s, uint64_t ticks) {
+    Stage& st = stages[s];
+    inc(st.counts[Histogram::bucket(ticks)], 1);
+    inc(st.count, 1);
+    inc(st.sum, ticks);
+    if(ticks > st.max.load(std::memory_order_relaxed)) st.max.store(ticks, std::memory_order_relaxed);
+  }
+  // the node's entry, nullptr if the table is full
+  Node* node(uint64_t mac) {
+    const uint64_t key = mac + 1;
+    for(size_t i = hash(key), n = 0; n < NODES; i = (i + 1) & (NODES - 1), ++n) {
+      const uint64_t k = nodes[i].key.load(std::memory_order_acquire);
+      if(k == key) return &nodes[i];
+      if(!k) {
+        nodes[i].key.store(key, std::memory_order_release);
+        return &nodes[i];
+      }
+    }
+    inc(dropped, 1);
+    return nullptr;
+  }
+  // the entry for reports of MACs that aren't nodes
+  Node* other() { return &others; }
+  void count(Node* n, counter_t c, uint64_t v = 1) { if(n) inc(n->counters[c], v); }
+  void seen(Node* n, uint32_t timeMs) { if(n) n->lastSeenMs.store(timeMs, std::memory_order_relaxed); }
+
+  void addTo(Snapshot& s) const;
+  void clear();
+
+private:
+  struct Stage {
+    std::atomic<uint64_t> counts[Histogram::BUCKETS];
+    std::atomic<uint64_t> count, sum, max;
+  };
+
+  // the only writer is the owner thread: no RMW needed, readers see whole values
+  static void inc(std::atomic<uint64_t>& a, const uint64_t v) {
+    a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+  }
+  static size_t hash(uint64_t key) { return size_t((key * 0x9E3779B97F4A7C15ULL) >> 52) & (NODES - 1); }
+
+  Stage stages[STAGES];
+  Node nodes[NODES];
+  Node others;
+  std::atomic<uint64_t> dropped{0};
+};
+
+// the callers' switch: with tracing off they skip local() and now() altogether
+extern std::atomic<bool> active;
+inline bool enabled() { return active.load(std::memory_order_relaxed); }
+inline void setEnabled(bool on) { active.store(on, std::memory_order_relaxed); }
+
+// this thread's slot, registered on the first call
+Slot& local();
+
+// merged slots of all threads
+void snapshot(Snapshot& s);
+// zeroes counts of all slots (nodes keep their places); records racing with it may survive
+void clear();
+
+// Prometheus text exposition format 0.0.4: latency summaries (seconds) per stage, adverts, counters and last seen
+// per node
+std::string prometheusText(const Snapshot& s);
+// little-endian: "WNTR", version, nsPerTick, threads, dropped, per stage: count, sum, max, non-empty buckets
+// (index, count); nodes: MAC, counters, last seen; counters of other MACs
+void writeBinary(const Snapshot& s, std::vector<uint8_t>& out);
+bool readBinary(const uint8_t* data, size_t len, Snapshot& s);
+
+}
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * Tracing overhead at full load: the ingest (decode, dedup, aggregate, publish to the in-process broker) runs over
+ * a pre-built stream of reports as fast as it can, tracing goes on and off every SEGMENT reports and the thread CPU
+ * time of each mode is summed - the rate of a host shared with others drifts more between whole runs than tracing
+ * costs. The stream: nodes advertising every 2 s on 3 channels, a new sensor reading every 2 min, ~1% CRC failures
+ * and ~5% adverts of foreign devices.
+ * The scanner stamps reportTicks per chunk of CHUNK reports: one clock read per radio buffer, which it takes for
+ * timeMs anyway, so the stamp goes to both modes.
+ *
+ * trace_bench [nodes] [minutes] [passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "ingest.h"
+#include "fake_broker.h"
+#include "trace.h"
+
+static const uint32_t ADVERT_MS = 2000;
+static const uint32_t POLL_MS = 120000;
+static const uint32_t FLUSH_MS = 1000;
+static const unsigned CHANNELS = 3;
+static const size_t CHUNK = 32;
+static const size_t SEGMENT = 2048;
+
+static std::vector<RawAdvert> stream(const unsigned nodes, const unsigned minutes, const unsigned seed) {
+  static const uint8_t V1_DATA[] = {
+    2, 0x01, 0x05,
+    6, 0x09, 'w', 'N', 'o', 'd', 'e',
+    9, 0xFF, 0xA9, 0x53, 0x01, 0xC2, 0x00, 0xFA, 0x01, 0x00
+  };
+  static const uint8_t FOREIGN[] = {2, 0x01, 0x06, 5, 0xFF, 0x4C, 0x00, 0x10, 0x05};
+  std::mt19937 rnd(seed);
+  std::vector<uint32_t> phase(nodes);
+  std::vector<uint16_t> humidity(nodes);
+  for(unsigned i = 0; i < nodes; ++i) {
+    phase[i] = rnd() % ADVERT_MS;
+    humidity[i] = 400 + rnd() % 200;
+  }
+  std::vector<RawAdvert> out;
+  for(uint32_t now = 0; now < minutes * 60000; now += FLUSH_MS) {
+    for(unsigned i = 0; i < nodes; ++i) {
+      const uint32_t t = (now / ADVERT_MS) * ADVERT_MS + phase[i];
+      if(t < now || t >= now + FLUSH_MS) continue;
+      if(t % POLL_MS < ADVERT_MS && rnd() % 2) humidity[i] += int(rnd() % 11) - 5;
+      RawAdvert a;
+      a.mac = 0xC0FFEE000000ULL + i;
+      a.timeMs = t;
+      a.len = sizeof(V1_DATA);
+      memcpy(a.data, V1_DATA, sizeof(V1_DATA));
+      a.data[14] = uint8_t(humidity[i] >> 8);
+      a.data[15] = uint8_t(humidity[i]);
+      for(unsigned c = 0; c < CHANNELS; ++c, ++a.timeMs) {
+        RawAdvert copy = a;
+        copy.crcOk = rnd() % 100 != 0;
+        out.push_back(copy);
+      }
+      if(rnd() % 7 == 0) {
+        RawAdvert f;
+        f.mac = 0x5A0000000000ULL + rnd() % 64;
+        f.timeMs = t;
+        f.len = sizeof(FOREIGN);
+        memcpy(f.data, FOREIGN, sizeof(FOREIGN));
+        out.push_back(f);
+      }
+    }
+  }
+  return out;
+}
+
+static double cpuSeconds() {
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+struct Pass {
+  double seconds[2] = {0, 0};   // off, on
+  size_t reports[2] = {0, 0};
+  uint64_t accepted = 0;
+
+  double overhead() const { return seconds[1] / reports[1] / (seconds[0] / reports[0]) - 1; }
+};
+
+// one pass over the stream, starting with tracing on or off
+static Pass run(std::vector<RawAdvert>& reports, const bool onFirst) {
+  FakeBroker broker;
+  broker.keepMessages = false;
+  MqttPublisher pub(broker);
+  Ingest in(pub);
+  Pass p;
+  uint32_t flushMs = FLUSH_MS;
+  for(size_t i = 0; i < reports.size(); i += SEGMENT) {
+    const bool on = ((i / SEGMENT) & 1) != onFirst;
+    const size_t end = std::min(reports.size(), i + SEGMENT);
+    trace::setEnabled(on);
+    const double start = cpuSeconds();
+    for(size_t j = i; j < end; ++j) {
+      if((j - i) % CHUNK == 0) {
+        const uint64_t t = trace::now();
+        for(size_t k = j; k < std::min(end, j + CHUNK); ++k) reports[k].reportTicks = t;
+      }
+      if(reports[j].timeMs >= flushMs) {
+        in.tick(flushMs);
+        flushMs += FLUSH_MS;
+      }
+      in.report(reports[j]);
+    }
+    p.seconds[on] += cpuSeconds() - start;
+    p.reports[on] += end - i;
+  }
+  in.tick(flushMs);
+  trace::setEnabled(true);
+  p.accepted = in.accepted();
+  return p;
+}
+
+int main(int argc, char** argv)
+{
+  const unsigned nodes = argc > 1? atoi(argv[1]) : 500;
+  const unsigned minutes = argc > 2? atoi(argv[2]) : 30;
+  const unsigned passes = argc > 3? atoi(argv[3]) : 9;
+
+  std::vector<RawAdvert> reports = stream(nodes, minutes, 1);
+  trace::nsPerTick();
+
+  Pass total;
+  std::vector<double> overhead;
+  for(unsigned i = 0; i < passes; ++i) {
+    const Pass p = run(reports, i & 1);
+    for(unsigned m = 0; m < 2; ++m) {
+      total.seconds[m] += p.seconds[m];
+      total.reports[m] += p.reports[m];
+    }
+    total.accepted = p.accepted;
+    overhead.push_back(p.overhead());
+  }
+  std::sort(overhead.begin(), overhead.end());
+
+  trace::Snapshot s;
+  trace::snapshot(s);
+  std::vector<uint8_t> bin;
+  trace::writeBinary(s, bin);
+  const std::string text = trace::prometheusText(s);
+
+  printf("%u nodes, %u min: %zu reports per pass, %llu accepted\n", nodes, minutes, reports.size(), (unsigned long long)total.accepted);
+  printf("tracing off: %.2fM reports/s\n", total.reports[0] / total.seconds[0] / 1e6);
+  printf("tracing on:  %.2fM reports/s\n", total.reports[1] / total.seconds[1] / 1e6);
+  printf("overhead: %.2f%% (%u passes; per pass median %.2f%%, %.2f%% .. %.2f%%)\n", total.overhead() * 100, passes,
+    overhead[passes / 2] * 100, overhead.front() * 100, overhead.back() * 100);
+  printf("stage latency, ns (p50 / p99 / p99.9):\n");
+  for(unsigned i = 0; i < trace::STAGES; ++i) {
+    const trace::Histogram& h = s.stages[i];
+    printf("  %-9s %8.0f %8.0f %8.0f  (%llu samples)\n", trace::stageName(trace::stage_t(i)), h.quantile(0.5) * s.nsPerTick,
+      h.quantile(0.99) * s.nsPerTick, h.quantile(0.999) * s.nsPerTick, (unsigned long long)h.count);
+  }
+  printf("snapshot: %zu nodes, %zu bytes binary, %zu bytes Prometheus text\n", s.nodes.size(), bin.size(), text.size());
+  return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Ingest tracing: histogram accuracy, per-thread slots merged in a snapshot, node counters and stage latencies
+ * recorded by the ingest, the node table limit, Prometheus text, binary dump round trip, the HTTP endpoint
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include "trace.h"
+#include "ingest.h"
+#include "metrics_server.h"
+#include "fake_broker.h"
+
+using trace::Histogram;
+using trace::Snapshot;
+
+static unsigned fails = 0;
+#define CHECK(cond) do { if(!(cond)) { ++fails; printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while(0)
+
+static const uint64_t MAC = 0xA1B2C3D4E5F6ULL;
+
+// v1 data advert: flags chunk, name chunk, manufacturer data: UUID, humidity, temperature, flags, reserved
+static RawAdvert advert(const uint64_t mac, const uint32_t timeMs, const uint16_t humidity) {
+  static const uint8_t V1_DATA[] = {
+    2, 0x01, 0x05,
+    6, 0x09, 'w', 'N', 'o', 'd', 'e',
+    9, 0xFF, 0xA9, 0x53, 0x01, 0xC2, 0x00, 0xFA, 0x01, 0x00
+  };
+  RawAdvert a;
+  a.mac = mac;
+  a.timeMs = timeMs;
+  a.reportTicks = trace::now();
+  a.len = sizeof(V1_DATA);
+  memcpy(a.data, V1_DATA, sizeof(V1_DATA));
+  a.data[14] = uint8_t(humidity >> 8);
+  a.data[15] = uint8_t(humidity);
+  return a;
+}
+
+static void histogram() {
+  for(uint64_t v = 0; v < 100000; v += 7) {
+    const unsigned b = Histogram::bucket(v);
+    CHECK(Histogram::lowest(b) <= v && v < Histogram::lowest(b + 1));
+  }
+  CHECK(Histogram::bucket(uint64_t(1) << 50) == Histogram::BUCKETS - 1);
+
+  Histogram h;
+  for(uint64_t v = 1; v <= 100000; ++v) h.record(v);
+  CHECK(h.count == 100000 && h.max == 100000 && h.sum == 100000ULL * 100001 / 2);
+  for(const double q : {0.5, 0.9, 0.99, 0.999}) {
+    const double err = double(h.quantile(q)) / (q * 100000) - 1;
+    CHECK(err >= 0 && err <= 1.0 / (1 << Histogram::SUB_BITS));
+  }
+  CHECK(h.quantile(1) == 100000);
+  CHECK(Histogram().quantile(0.5) == 0);
+
+  Histogram m;
+  m.record(200000);
+  m.merge(h);
+  CHECK(m.count == h.count + 1 && m.max == 200000 && m.quantile(1) == 200000 && m.quantile(0.5) == h.quantile(0.5));
+}
+
+static void slots() {
+  trace::clear();
+  auto work = [](const unsigned n) {
+    trace::Slot& s = trace::local();
+    trace::Slot::Node* node = s.node(MAC);
+    for(unsigned i = 0; i < n; ++i) {
+      s.latency(trace::DECODE, 100);
+      s.count(node, trace::ACCEPTED);
+    }
+    s.seen(node, n);
+  };
+  std::thread a(work, 1000), b(work, 2000);
+  a.join();
+  b.join();
+
+  Snapshot s;
+  trace::snapshot(s);
+  CHECK(s.threads >= 2);
+  CHECK(s.stages[trace::DECODE].count == 3000 && s.stages[trace::DECODE].max == 100);
+  CHECK(s.nodes[MAC].counters[trace::ACCEPTED] == 3000 && s.nodes[MAC].adverts() == 3000 && s.nodes[MAC].lastSeenMs == 2000);
+
+  trace::clear();
+  trace::snapshot(s);
+  CHECK(s.stages[trace::DECODE].count == 0 && s.nodes[MAC].adverts() == 0);
+}
+
+static void nodeTable() {
+  std::unique_ptr<trace::Slot> slot(new trace::Slot());
+  for(uint64_t mac = 0; mac < trace::Slot::NODES; ++mac) CHECK(slot->node(mac) != nullptr);
+  CHECK(slot->node(5) == slot->node(5));
+  CHECK(slot->node(trace::Slot::NODES) == nullptr);
+  slot->count(nullptr, trace::ACCEPTED);
+  Snapshot s;
+  slot->addTo(s);
+  CHECK(s.nodes.size() == trace::Slot::NODES && s.droppedNodes == 1);
+}
+
+static void ingest() {
+  trace::clear();
+  FakeBroker broker;
+  MqttPublisher pub(broker);
+  IngestConfig cfg;
+  cfg.sampleUs = 0;
+  cfg.countersMs = 0;
+  Ingest in(pub, cfg);
+
+  in.report(advert(MAC, 0, 450));
+  in.report(advert(MAC, 10, 450));    // the copy on another channel
+  in.report(advert(MAC, 200, 450));   // the next advert, same data
+  RawAdvert bad = advert(MAC, 210, 460);
+  bad.crcOk = false;
+  in.report(bad);
+  bad = advert(MAC, 220, 460);
+  bad.data[12] = 0x42;                // someone else's manufacturer data
+  in.report(bad);
+  in.report(advert(MAC, 230, 470));
+  bad = advert(MAC + 1, 240, 450);    // not a node
+  bad.data[12] = 0x42;
+  in.report(bad);
+  bad.crcOk = false;
+  in.report(bad);
+  CHECK(in.accepted() == 3);
+  CHECK(in.tick(1000) == 1);
+  CHECK(in.tick(1100) == 0);
+  CHECK(broker.published > 0 && broker.retained.size() > 0);
+
+  Snapshot s;
+  trace::snapshot(s);
+  const trace::NodeStats& n = s.nodes[MAC];
+  CHECK(n.adverts() == 6 && n.counters[trace::ACCEPTED] == 3);
+  CHECK(n.counters[trace::DUPLICATES] == 1);
+  CHECK(n.counters[trace::CRC_FAILURES] == 1);
+  CHECK(n.counters[trace::DECODE_REJECTS] == 1);
+  CHECK(n.lastSeenMs == 230);
+  CHECK(s.nodes.find(MAC + 1) == s.nodes.end());
+  CHECK(s.other.counters[trace::DECODE_REJECTS] == 1 && s.other.counters[trace::CRC_FAILURES] == 1 && s.other.adverts() == 2);  CHECK(s.stages[trace::REPORT].count == 8);
+  CHECK(s.stages[trace::DECODE].count == 6);
+  CHECK(s.stages[trace::DEDUP].count == 4);
+  CHECK(s.stages[trace::AGGREGATE].count == 3);
+  CHECK(s.stages[trace::STORE].count == 1);
+
+  // off: nothing recorded, ingest goes on
+  trace::setEnabled(false);
+  in.report(advert(MAC, 2000, 480));
+  trace::setEnabled(true);
+  CHECK(in.accepted() == 4);
+  trace::snapshot(s);
+  CHECK(s.nodes[MAC].adverts() == 6 && s.stages[trace::REPORT].count == 8);
+}
+
+static void prometheus() {
+  Snapshot s;
+  trace::snapshot(s);
+  const std::string text = trace::prometheusText(s);
+  CHECK(text.find("# TYPE wnode_gateway_stage_seconds summary\n") != std::string::npos);
+  CHECK(text.find("wnode_gateway_stage_seconds{stage=\"decode\",quantile=\"0.99\"} ") != std::string::npos);
+  CHECK(text.find("wnode_gateway_stage_seconds_count{stage=\"store\"} 1\n") != std::string::npos);
+  CHECK(text.find("wnode_gateway_node_adverts_total{mac=\"a1b2c3d4e5f6\"} 6\n") != std::string::npos);
+  CHECK(text.find("wnode_gateway_node_accepted_total{mac=\"a1b2c3d4e5f6\"} 3\n") != std::string::npos);
+  CHECK(text.find("wnode_gateway_node_crc_failures_total{mac=\"a1b2c3d4e5f6\"} 1\n") != std::string::npos);
+  CHECK(text.find("wnode_gateway_node_last_seen_seconds{mac=\"a1b2c3d4e5f6\"} 0.230\n") != std::string::npos);
+  CHECK(text.find("wnode_gateway_other_decode_rejects_total 1\n") != std::string::npos);
+  CHECK(text.find("wnode_gateway_trace_dropped_nodes_total 0\n") != std::string::npos);
+}
+
+static void binary() {
+  Snapshot s, r;
+  trace::snapshot(s);
+  std::vector<uint8_t> bin;
+  trace::writeBinary(s, bin);
+  CHECK(trace::readBinary(bin.data(), bin.size(), r));
+  CHECK(r.nsPerTick == s.nsPerTick && r.threads == s.threads && r.droppedNodes == s.droppedNodes);
+  for(unsigned i = 0; i < trace::STAGES; ++i) {
+    CHECK(r.stages[i].count == s.stages[i].count && r.stages[i].sum == s.stages[i].sum && r.stages[i].max == s.stages[i].max);
+    CHECK(!memcmp(r.stages[i].counts, s.stages[i].counts, sizeof(s.stages[i].counts)));
+  }
+  CHECK(r.nodes.size() == s.nodes.size());
+  CHECK(r.nodes[MAC].counters[trace::DUPLICATES] == 1 && r.nodes[MAC].lastSeenMs == 230);
+  CHECK(r.other.counters[trace::CRC_FAILURES] == 1);
+
+  CHECK(!trace::readBinary(bin.data(), bin.size() - 1, r));
+  bin.push_back(0);
+  CHECK(!trace::readBinary(bin.data(), bin.size(), r));
+  bin.pop_back();
+  bin[0] = 'X';
+  CHECK(!trace::readBinary(bin.data(), bin.size(), r));
+}
+
+static std::string get(MetricsServer& server, const char* path) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(server.port());
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  std::string resp;
+  // the connection waits in the backlog until poll() serves it
+  if(connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+    const std::string req = std::string("GET ") + path + " HTTP/1.0\r\nHost: localhost\r\n\r\n";
+    if(send(fd, req.data(), req.size(), 0) == ssize_t(req.size()) && server.poll(1000) == 1) {
+      char buf[4096];
+      for(ssize_t n; (n = recv(fd, buf, sizeof(buf), 0)) > 0; ) resp.append(buf, size_t(n));
+    }
+  }
+  close(fd);
+  return resp;
+}
+
+static void server() {
+  MetricsServer server;
+  CHECK(server.listen(0) && server.port() != 0);
+  CHECK(server.poll(0) == 0);
+
+  std::string resp = get(server, "/metrics");
+  CHECK(resp.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+  CHECK(resp.find("Content-Type: text/plain; version=0.0.4\r\n") != std::string::npos);
+  CHECK(resp.find("wnode_gateway_node_adverts_total{mac=\"a1b2c3d4e5f6\"} 6\n") != std::string::npos);
+
+  resp = get(server, "/snapshot");
+  const size_t body = resp.find("\r\n\r\n");
+  Snapshot s;
+  CHECK(resp.find("Content-Type: application/octet-stream\r\n") != std::string::npos);
+  CHECK(body != std::string::npos && trace::readBinary((const uint8_t*)resp.data() + body + 4, resp.size() - body - 4, s));
+  CHECK(s.nodes[MAC].adverts() == 6);
+
+  resp = get(server, "/");
+  CHECK(resp.compare(0, 22, "HTTP/1.0 404 Not Found") == 0);
+}
+
+int main()
+{
+  histogram();
+  slots();
+  nodeTable();
+  ingest();
+  prometheus();
+  binary();
+  server();
+  printf("trace_test: %s\n", fails? "FAIL" : "OK");
+  return fails? 1 : 0;
+}
@@ -7,6 +7,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include "reg24le1.h"
 #include "gpio.h"
 #include "rf.h"
 #include "ble.h"
@@ -16,10 +17,14 @@
 #include "pwr_clk_mgmt.h"
 #include "dht22.h"
 #include "rng.h"
+#include "wnode_frame.h"
 
 /* LOGIC */
-#define POLL_SENSOR_EVERY_N_WAKEUPS 60 //once in 2 min
+#define WAKE_PERIOD_MS 1750 //TX slot period, RTC2 is calibrated to it (65536 ticks max: RCOSC32K up to +14%)
+#define POLL_SENSOR_EVERY_N_WAKEUPS 60 //once in ~2 min
 #define SENSOR_FAIL_READ_THRESHOLD 10
+#define TELEMETRY_EVERY_N_WAKEUPS 64 //send telemetry frame instead of data frame once in ~2 min
+#define CALIBRATE_EVERY_N_WAKEUPS 2048 //~1h, RCOSC32K drifts with temperature and Vdd
 
 /* WIREING */
 #define LED_PIN GPIO_PIN_ID_P0_0
@@ -29,6 +34,10 @@
 #define BLE_DEVICE_NAME "wNode1" //max 6 chars
 #define BLE_DEVICE_NAME_CHARS() (sizeof(BLE_DEVICE_NAME) - 1)
 #define UUID_TEMP2_HUM2 {0xA9, 0x53}
+#define UUID_TELEMETRY {0xA9, 0x54}
+
+/* --- BLE frame v2: Service Data with TLV records (wnode_frame.h) instead of name + Manufacturer Data --- */
+//#define BLE_FRAME_V2
 
 typedef enum {
     BATTERY_LEVEL_HIGH      = 0,
@@ -53,13 +62,35 @@ typedef struct {
     uint8_t reserve;
 } manuf_data_t;
 
-//returns length
-static uint8_t BLE_set_manuf_data(uint8_t* payload_start, const manuf_data_t* manuf_data) {
+//9 bytes (sent without flags chunk), counters are for the last telemetry window
+typedef struct {
+    uint8_t uuid[2];
+    uint8_t wakeups;
+    uint8_t tx_packets;
+    uint8_t sensor_reads;
+    uint8_t sensor_fails;
+    uint8_t active_time[3];     //total active time in the window, energy_minifloat() of 16us units: sensor, radio, other
+} telemetry_data_t;
+
+_Static_assert(sizeof(telemetry_data_t) - 2 == WNODE_TLV_TELEMETRY_LEN, "telemetry record doesn't match the frame schema");
+
+typedef enum {
+    FRAME_DATA,         //manuf_data_t
+    FRAME_TELEMETRY     //telemetry_data_t
+} frame_kind_t;
+
+#define MANUF_DATA_MAX_SIZE ((uint8_t)(21 - 2 - (BLE_DEVICE_NAME_CHARS() + 2))) //without flags chunk
+
+//returns length (v1 frames carry their kind in the UUID)
+static uint8_t BLE_set_manuf_data(uint8_t* payload_start, const frame_kind_t kind, const void* manuf_data, const uint8_t manuf_data_size) {
+    (void)kind;
     uint8_t* payload = payload_start;
-    //flags chunk
-    *payload++ = 2;
-    *payload++ = 0x01;
-    *payload++ = 0x05;
+    //flags chunk (optional for non-connectable advertising, dropped if data doesn't fit otherwise)
+    if(manuf_data_size + 3 <= MANUF_DATA_MAX_SIZE) {
+        *payload++ = 2;
+        *payload++ = 0x01;
+        *payload++ = 0x05;
+    }
 
     //name chunk
     *payload++ = BLE_DEVICE_NAME_CHARS() + 1;
@@ -68,10 +99,10 @@ static uint8_t BLE_set_manuf_data(uint8_t* payload_start, const manuf_data_t* ma
     payload += BLE_DEVICE_NAME_CHARS();
 
     //Manufacturer data chunk
-    *payload++ = 1 + sizeof(manuf_data_t);
+    *payload++ = 1 + manuf_data_size;
     *payload++ = 0xFF; //Manufacturer Specific Data
-    memcpy(payload, manuf_data, sizeof(manuf_data_t));
-    payload += sizeof(manuf_data_t);
+    memcpy(payload, manuf_data, manuf_data_size);
+    payload += manuf_data_size;
 
     return payload - payload_start;
 }
@@ -82,21 +113,73 @@ static uint8_t next_adv_channel_idx() {
     return idx;
 }
 
-static void BLE_send_manuf_data(const manuf_data_t* manuf_data, uint8_t trys) {
+#ifdef BLE_FRAME_V2
+_Static_assert(3 * 3 + 1 + WNODE_TLV_SCHEDULE_LEN <= WNODE_TLV_SPACE, "data frame doesn't fit");
+
+//manuf_data is manuf_data_t or telemetry_data_t according to kind, returns length
+static uint8_t BLE_set_service_data(uint8_t* payload_start, const frame_kind_t kind, const void* manuf_data, const uint8_t manuf_data_size) {
+    uint8_t* payload = payload_start;
+    (void)manuf_data_size; //records have fixed lengths
+    //flags chunk
+    *payload++ = 2;
+    *payload++ = 0x01;
+    *payload++ = 0x05;
+
+    //Service data chunk
+    uint8_t* const chunk_size = payload++;
+    *payload++ = 0x16; //Service Data - 16-bit UUID
+    *payload++ = WNODE_UUID16_V2 & 0xFF;
+    *payload++ = WNODE_UUID16_V2 >> 8;
+
+    //TLV records
+    if(kind == FRAME_TELEMETRY) {
+        *payload++ = WNODE_TLV_HEADER(WNODE_TLV_TELEMETRY, WNODE_TLV_TELEMETRY_LEN);
+        memcpy(payload, &((const telemetry_data_t*)manuf_data)->wakeups, WNODE_TLV_TELEMETRY_LEN);
+        payload += WNODE_TLV_TELEMETRY_LEN;
+    } else {
+        const manuf_data_t* const data = (const manuf_data_t*)manuf_data;
+        *payload++ = WNODE_TLV_HEADER(WNODE_TLV_STATUS, WNODE_TLV_STATUS_LEN);
+        *payload++ = *(const uint8_t*)&data->flags;
+        *payload++ = WNODE_TLV_HEADER(WNODE_TLV_TEMPERATURE, WNODE_TLV_TEMPERATURE_LEN);
+        *payload++ = data->temperature[0];
+        *payload++ = data->temperature[1];
+        *payload++ = WNODE_TLV_HEADER(WNODE_TLV_HUMIDITY, WNODE_TLV_HUMIDITY_LEN);
+        *payload++ = data->humidity[0];
+        *payload++ = data->humidity[1];
+    }
+    //TX schedule, the gateway opens its scan window around the expected arrival
+    *payload++ = WNODE_TLV_HEADER(WNODE_TLV_SCHEDULE, WNODE_TLV_SCHEDULE_LEN);
+    *payload++ = WAKE_PERIOD_MS >> 8;
+    *payload++ = WAKE_PERIOD_MS & 0xFF;
+
+    *chunk_size = payload - chunk_size - 1;
+    return payload - payload_start;
+}
+#define BLE_set_payload BLE_set_service_data
+#else
+#define BLE_set_payload BLE_set_manuf_data
+#endif
+
+//manuf_data_size is max MANUF_DATA_MAX_SIZE bytes, returns number of packets transmitted
+static uint8_t BLE_send_manuf_data(const frame_kind_t kind, const void* manuf_data, const uint8_t manuf_data_size, uint8_t trys) {
+    const uint8_t sent = trys;
     uint8_t* payload = BLE_init();
 
     //check if the same data
-    static uint8_t prvData[sizeof(manuf_data_t)];
-    if(memcmp(prvData, manuf_data, sizeof(manuf_data_t)) != 0) {
-        const uint8_t payload_size = BLE_set_manuf_data(payload, manuf_data);
+    static uint8_t prvData[MANUF_DATA_MAX_SIZE];
+    static uint8_t prvSize = 0;
+    if(prvSize != manuf_data_size || memcmp(prvData, manuf_data, manuf_data_size) != 0) {
+        const uint8_t payload_size = BLE_set_payload(payload, kind, manuf_data, manuf_data_size);
         BLE_prepare(ble_mac, payload_size);
-        memcpy(prvData, manuf_data, sizeof(manuf_data_t));
+        memcpy(prvData, manuf_data, manuf_data_size);
+        prvSize = manuf_data_size;
     }
 
     while(trys--) {
         BLE_send(next_adv_channel_idx());
     }
     BLE_deinit();
+    return sent;
 }
 
 /* --- MAC generation --- */
@@ -154,14 +237,32 @@ static void initSysTick() {
     //run RTC2
     rtc2_configure(
         RTC2_CONFIG_OPTION_ENABLE | RTC2_CONFIG_OPTION_COMPARE_MODE_0_RESET_AT_IRQ,
-        0xFFFF //0.5Hz
+        0xFFFF //0.5Hz, until calibrated
     );
+
+    //timer0 for energy accounting: 16-bit free-running, CCLK/12, stopped together with CCLK while sleeping
+    TMOD = (TMOD & 0xF0) | 0x01;
+    TR0 = 1;
 }
 
+#define RTC2_HZ 32768UL
+#define WAKE_PERIOD_RTC2_TICKS ((uint32_t)WAKE_PERIOD_MS * RTC2_HZ / 1000) //nominal
+
+static uint16_t rtc2_period = WAKE_PERIOD_RTC2_TICKS - 1; //compare value of a whole wake period, see rtc2_calibrate()
+static uint16_t rtc2_slept = 0; //RTC2 ticks of the current period spent in sleep() already
+
+//wake up after ticks + 1 RTC2 ticks since the last wakeup (the counter is reset at the compare match and keeps running while awake)
 static void sleep(const uint16_t ticks) {
     rtc2_set_compare_val(ticks);
     pwr_clk_mgmt_enter_pwr_mode_register_ret();
     pwr_clk_mgmt_wait_until_cclk_src_is_xosc16m();
+    rtc2_slept += ticks + 1;
+}
+
+//sleep the rest of the wake period, so TX slots keep WAKE_PERIOD_MS whatever the node did in between
+static void sleep_until_slot() {
+    sleep(rtc2_period - rtc2_slept);
+    rtc2_slept = 0;
 }
 
 static battery_level_t get_battery_level() {
@@ -221,6 +322,103 @@ static bool updateSensorData(manuf_data_t* device_data) {
     return ok;
 }
 
+/* --- Energy accounting --- */
+
+//timer0 runs at 16MHz/12 (0.75us per tick), telemetry unit is 16us: units = ticks * 3 / 64
+#define ENERGY_TICKS_TO_UNITS(ticks) ((ticks) * 3 / 64)
+
+typedef enum {
+    ENERGY_PHASE_SENSOR = 0,
+    ENERGY_PHASE_RADIO  = 1,
+    ENERGY_PHASE_OTHER  = 2,
+    ENERGY_PHASE_COUNT
+} energy_phase_t;
+
+static struct {
+    uint8_t wakeups;
+    uint8_t tx_packets;
+    uint8_t sensor_reads;
+    uint8_t sensor_fails;
+    uint32_t active_ticks[ENERGY_PHASE_COUNT];
+} energy;
+
+static uint16_t energy_timer_val() {
+    uint8_t h, l;
+    do {
+        h = TH0;
+        l = TL0;
+    } while(h != TH0);
+    return ((uint16_t)h << 8) | l;
+}
+
+//account active time since 'start' to the phase (single span should be < 49ms), returns current timer value
+static uint16_t energy_account(const energy_phase_t phase, const uint16_t start) {
+    const uint16_t now = energy_timer_val();
+    energy.active_ticks[phase] += (uint16_t)(now - start);
+    return now;
+}
+
+//8-bit float: exponent in bits 4-7, mantissa in bits 0-3, value = e? (16 + m) << (e - 1) : m (rounded down, max ~500k)
+static uint8_t energy_minifloat(uint32_t v) {
+    uint8_t e = 1;
+    if(v < 16) return v;
+    while(v >= 32) {
+        v >>= 1;
+        ++e;
+    }
+    return e > 15? 0xFF : (e << 4) | (v - 16);
+}
+
+/* --- RTC2 calibration --- */
+
+//RCOSC32K is +-several %, so RTC2 is measured against XOSC16M (timer0): timer0 ticks in CAL_RTC2_TICKS RTC2 ticks
+//vs the nominal count give RTC2 ticks in WAKE_PERIOD_MS; ~31ms busy wait, the count is +-2 timer0 ticks (~50ppm)
+#define CAL_RTC2_TICKS 1024
+#define CAL_TIMER0_NOMINAL ((uint16_t)(16000000UL / 12 * CAL_RTC2_TICKS / RTC2_HZ)) //41666, doesn't wrap down to -36%
+#define RTC2CON_SFR_CAPTURE 0x10 //RTC2CON.sfrCapture: latch the counter into RTC2CPT00/01
+
+static uint16_t rtc2_counter() {
+    RTC2CON |= RTC2CON_SFR_CAPTURE;
+    return ((uint16_t)RTC2CPT01 << 8) | RTC2CPT00;
+}
+
+//should run early in a wake, so RTC2 doesn't reach the compare value meanwhile
+static void rtc2_calibrate() {
+    uint16_t start = rtc2_counter();
+    while(rtc2_counter() == start); //align to a tick edge
+    ++start;
+    const uint16_t t = energy_timer_val();
+    while((uint16_t)(rtc2_counter() - start) < CAL_RTC2_TICKS);
+    const uint16_t ticks = energy_timer_val() - t;
+    const uint32_t period = (WAKE_PERIOD_RTC2_TICKS * CAL_TIMER0_NOMINAL + ticks / 2) / ticks;
+    rtc2_period = period > 0x10000? 0xFFFF : period - 1;
+}
+
+//fill telemetry frame and start new window
+static void energy_to_telemetry(telemetry_data_t* telemetry) {
+    telemetry->wakeups = energy.wakeups;
+    telemetry->tx_packets = energy.tx_packets;
+    telemetry->sensor_reads = energy.sensor_reads;
+    telemetry->sensor_fails = energy.sensor_fails;
+    for(uint8_t i = 0; i < ENERGY_PHASE_COUNT; ++i)
+        telemetry->active_time[i] = energy_minifloat(ENERGY_TICKS_TO_UNITS(energy.active_ticks[i]));
+    memset(&energy, 0, sizeof(energy));
+}
+
+//read the sensor, update status flags and counters
+static void poll_sensor(manuf_data_t* device_data) {
+    static uint8_t sensorErrors = 0;
+    ++energy.sensor_reads;
+    if(!updateSensorData(device_data)) {
+        ++energy.sensor_fails;
+        if(sensorErrors < 255) ++sensorErrors;
+    } else sensorErrors = 0;
+    //update sensor fail flag
+    device_data->flags.sensor_fail = sensorErrors > SENSOR_FAIL_READ_THRESHOLD;
+    //update battery level
+    device_data->flags.battery_level = get_battery_level();
+}
+
 /* --- Main --- */
 
 void main(void) {
@@ -249,26 +447,43 @@ void main(void) {
         0
     };
 
-    uint8_t wakeups = POLL_SENSOR_EVERY_N_WAKEUPS;
-    uint8_t sensorErrors = 0;
+    telemetry_data_t telemetry = { UUID_TELEMETRY };
+
+    rtc2_calibrate();
+    poll_sensor(&device_data);
+
+    uint8_t wakeups = 0;
+    uint16_t calibration_wakeups = 0;
     while(1) {
-        ++wakeups;
-        if(wakeups >= POLL_SENSOR_EVERY_N_WAKEUPS) {
-            if(!updateSensorData(&device_data)) {
-                if(sensorErrors < 255) ++sensorErrors;
-            } else sensorErrors = 0;
-            //update sensor fail flag
-            device_data.flags.sensor_fail = sensorErrors > SENSOR_FAIL_READ_THRESHOLD;
-            //update battery level
-            device_data.flags.battery_level = get_battery_level();
-            wakeups = 0;
-        }
+        //a wake starts with TX, so adverts keep the slot schedule; sensor data is one period old at most
+        uint16_t t = energy_timer_val();
+        ++energy.wakeups;
 
         gpio_pin_val_set(LED_PIN);
-        BLE_send_manuf_data(&device_data, 3);
-
+        if(energy.wakeups >= TELEMETRY_EVERY_N_WAKEUPS) {
+            energy_to_telemetry(&telemetry);
+            t = energy_account(ENERGY_PHASE_OTHER, t);
+            energy.tx_packets += BLE_send_manuf_data(FRAME_TELEMETRY, &telemetry, sizeof(telemetry), 3);
+        } else {
+            t = energy_account(ENERGY_PHASE_OTHER, t);
+            energy.tx_packets += BLE_send_manuf_data(FRAME_DATA, &device_data, sizeof(device_data), 3);
+        }
+        t = energy_account(ENERGY_PHASE_RADIO, t);
         gpio_pin_val_clear(LED_PIN);
-        sleep(0xFFFF);
+
+        if(++calibration_wakeups >= CALIBRATE_EVERY_N_WAKEUPS) {
+            rtc2_calibrate();
+            calibration_wakeups = 0;
+        }
+        if(++wakeups >= POLL_SENSOR_EVERY_N_WAKEUPS) {
+            t = energy_account(ENERGY_PHASE_OTHER, t);
+            poll_sensor(&device_data);
+            t = energy_account(ENERGY_PHASE_SENSOR, t);
+            wakeups = 0;
+        }
+
+        energy_account(ENERGY_PHASE_OTHER, t);
+        sleep_until_slot();
         //gpio_pin_val_set(LED_PIN);
     }
 }
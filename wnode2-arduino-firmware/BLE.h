@@ -174,6 +174,11 @@ bool advertise( uint8_t data_type, void* buf, uint8_t buflen )
   // add custom data, if applicable
   if (buflen > 0) {
     bool success = addChunk(data_type, buflen, buf);
+    if(!success) {
+      // flags chunk is optional for non-connectable advertising, drop it if the data doesn't fit otherwise
+      preparePacket(false);
+      success = addChunk(data_type, buflen, buf);
+    }
     if(!success)  return false;
   }
   transmitPacket();
@@ -207,7 +212,7 @@ void randomMAC()
   mac[5] = ((__DATE__[9]-0x30) << 4) | (__DATE__[10]-0x30) | 0xC0; // static random address should have two topmost bits set
 }
 
-void preparePacket() 
+void preparePacket(bool flagsChunk = true) 
 {
   buffer.mac[0] = mac[5];
   buffer.mac[1] = mac[4];
@@ -219,8 +224,10 @@ void preparePacket()
   buffer.pl_size = 6; //including MAC
   
   // add device descriptor chunk
-  uint8_t flags = 0x05;
-  addChunk(0x01, 1, &flags); // flags chunk
+  if(flagsChunk) {
+    uint8_t flags = 0x05;
+    addChunk(0x01, 1, &flags); // flags chunk
+  }
   
   if(strlen(name) > 0) {
     addChunk(0x09, strlen(name), name); // name chunk
@@ -0,0 +1,71 @@
+/*
+ * Runs on the target: cycle counts of the sketch's fixed-point conversions against the float code they replaced.
+ * Timer1 counts CPU cycles (no prescaler), each conversion is timed over a range of readings with interrupts off,
+ * the mean goes to Serial at 115200 (8MHz board). Build and upload with `make avr-bench-upload PORT=...`.
+ */
+
+// the sketch provides the conversions, the bench has its own setup() and loop()
+#define setup wnodeSetup
+#define loop wnodeLoop
+#include "../wnode2-arduino-firmware.ino"
+#undef setup
+#undef loop
+#include "float_reference.h"
+
+#define BENCH_SAMPLES 256
+
+volatile uint16_t benchInput;
+volatile int16_t benchSink;
+
+// mean cycles of f(reading) over BENCH_SAMPLES readings starting from 'first', measurement overhead included
+template<typename F> uint16_t benchCycles(const uint16_t first, const uint16_t step, F f)
+{
+  uint32_t total = 0;
+  for(uint16_t i = 0; i < BENCH_SAMPLES; ++i) {
+    benchInput = first + i*step;
+    cli();
+    TCNT1 = 0;
+    benchSink = f(benchInput);
+    const uint16_t c = TCNT1;
+    sei();
+    total += c;
+  }
+  return total / BENCH_SAMPLES;
+}
+
+void printResult(const __FlashStringHelper* name, const uint16_t floatCycles, const uint16_t fixedCycles, const uint16_t overhead)
+{
+  Serial.print(name);
+  Serial.print(F(": float "));
+  Serial.print(floatCycles - overhead);
+  Serial.print(F(" cycles, fixed-point "));
+  Serial.print(fixedCycles - overhead);
+  Serial.println(F(" cycles"));
+}
+
+void setup()
+{
+#ifdef F_CRYSTAL_16MHZ
+  CLKPR = (1<<CLKPCE);
+  CLKPR = (1<<CLKPS0);
+#endif
+  Serial.begin(115200);
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+
+  const int8_t off = boot_signature_byte_get(4);
+  const uint8_t gain = boot_signature_byte_get(3);
+  const uint16_t overhead = benchCycles(0, 1, [](uint16_t adc) { return int16_t(adc); });
+
+  // internal sensor readings around room temperature, Vcc readings from 3.6V down to 2.5V
+  printResult(F("intTemp"),
+    benchCycles(1200, 1, [=](uint16_t adc) { return intTempFloat(adc, off, gain); }),
+    benchCycles(1200, 1, [=](uint16_t adc) { return intTempConvert(adc, off, gain); }),
+    overhead);
+  printResult(F("batteryLevel"),
+    benchCycles(1250, 2, [](uint16_t adc) { return int16_t(batteryLevelFloat(adc)); }),
+    benchCycles(1250, 2, [](uint16_t adc) { return int16_t(WeatherNodeData::toBatteryLevel(adc)); }),
+    overhead);
+}
+
+void loop() {}
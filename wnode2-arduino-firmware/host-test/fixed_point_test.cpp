@@ -0,0 +1,34 @@
+/*
+ * Compares fixed-point conversions of the sketch against the float code they replaced
+ */
+
+#include <stdio.h>
+#include "../wnode2-arduino-firmware.ino"
+#include "float_reference.h"
+
+int main()
+{
+  unsigned fails = 0;
+  const uint16_t ADC_MAX = 1024 << ADC_OVERSAMPLE_BITS;
+
+  for(int off = -128; off < 128; ++off)
+    for(int gain = 1; gain < 256; ++gain)
+      for(uint16_t adc = 0; adc < ADC_MAX; ++adc) {
+        const int16_t f = intTempFloat(adc, off, gain), x = intTempConvert(adc, off, gain);
+        if(f != x && fails++ < 10) printf("intTemp: adc %u, offset %d, gain %d: float %d, fixed %d\n", adc, off, gain, f, x);
+      }
+
+  for(uint16_t adc = 1; adc < ADC_MAX; ++adc) {
+    const int f = batteryLevelFloat(adc), x = WeatherNodeData::toBatteryLevel(adc);
+    if(f != x && fails++ < 10) printf("batteryLevel: adc %u: float %d, fixed %d\n", adc, f, x);
+  }
+
+  for(long n = -100000; n <= 100000; ++n)
+    for(uint16_t d = 1; d < 600; d += 7) {
+      const long f = lround(double(n) / d), x = divRound(n, d);
+      if(f != x && fails++ < 10) printf("divRound: %ld / %u: float %ld, fixed %ld\n", n, d, f, x);
+    }
+
+  printf("fixed_point_test: %s (%u mismatches)\n", fails? "FAIL" : "OK", fails);
+  return fails? 1 : 0;
+}
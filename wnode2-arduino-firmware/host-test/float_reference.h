@@ -0,0 +1,26 @@
+/*
+ * Float code replaced by the fixed-point conversions of the sketch (applied to the oversampled readings),
+ * used as the reference by fixed_point_test and avr_bench
+ */
+
+#ifndef FLOAT_REFERENCE_H
+#define FLOAT_REFERENCE_H
+
+// readIntTemp(): 25 + (ADC - (373 - TS_OFFSET))*128/TS_GAIN, then round(temperature*10)
+static int16_t intTempFloat(const uint16_t adc, const int8_t tsOffset, const uint8_t tsGain)
+{
+  const float t = 25.f + float((long(adc) - (long(373 - tsOffset) << ADC_OVERSAMPLE_BITS))*128) / float(tsGain << ADC_OVERSAMPLE_BITS);
+  return lroundf(t*10);
+}
+
+// readVcc(): Vcc in mV, then toBatteryLevel(round(v/100.))
+static WeatherNodeData::battery_level_t batteryLevelFloat(const uint16_t vccAdc)
+{
+  const long v = lround((VCC_ADC_K / vccAdc) / 100.);
+  if(v > 30) return WeatherNodeData::BATTERY_LEVEL_HIGH;
+  if(v > 28) return WeatherNodeData::BATTERY_LEVEL_MED_HIGH;
+  if(v > 26) return WeatherNodeData::BATTERY_LEVEL_MED_LOW;
+  return WeatherNodeData::BATTERY_LEVEL_LOW;
+}
+
+#endif
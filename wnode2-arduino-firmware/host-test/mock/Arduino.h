@@ -0,0 +1,85 @@
+/*
+ * Host-side mock of the Arduino core (just what the sketch uses)
+ */
+
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define F_CPU 8000000
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+#define ISR(vector) void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void) {}
+
+// registers
+extern volatile uint8_t ADMUX, ADCSRA, CLKPR, WDTCSR;
+extern volatile uint16_t ADC;
+extern volatile uint8_t TCCR1A, TCCR1B;
+extern volatile uint16_t TCNT1;
+#define CS10 0
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define REFS0 6
+#define REFS1 7
+#define ADIE 3
+#define ADSC 6
+#define ADEN 7
+#define CLKPS0 0
+#define CLKPCE 7
+#define WDIE 6
+
+void cli();
+void sei();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long micros();
+unsigned long millis();
+
+class MockSerial {
+public:
+  void begin(unsigned long) { ++calls; }
+  void end() { ++calls; }
+  void flush() { ++calls; }
+  template<typename T> void print(const T&) { ++calls; }
+  template<typename T> void println(const T&) { ++calls; }
+  unsigned calls = 0;
+};
+extern MockSerial Serial;
+
+#endif
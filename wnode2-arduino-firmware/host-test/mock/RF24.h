@@ -0,0 +1,49 @@
+/*
+ * Host-side mock of the RF24 library (just what the sketch and BLE.h use)
+ */
+
+#ifndef MOCK_RF24_H
+#define MOCK_RF24_H
+
+#include <stdint.h>
+
+typedef enum { RF24_PA_MIN = 0, RF24_PA_LOW, RF24_PA_HIGH, RF24_PA_MAX } rf24_pa_dbm_e;
+typedef enum { RF24_1MBPS = 0, RF24_2MBPS, RF24_250KBPS } rf24_datarate_e;
+typedef enum { RF24_CRC_DISABLED = 0, RF24_CRC_8, RF24_CRC_16 } rf24_crclength_e;
+
+class RF24 {
+public:
+  RF24(uint16_t, uint16_t) {}
+
+  // every call is an SPI transaction
+  bool begin();
+  void setAutoAck(bool) { spi(); }
+  bool setDataRate(rf24_datarate_e) { spi(); return true; }
+  void disableCRC() { spi(); crc = RF24_CRC_DISABLED; }
+  void setChannel(uint8_t) { spi(); }
+  void setRetries(uint8_t, uint8_t) { spi(); }
+  void setPALevel(uint8_t) { spi(); }
+  void setAddressWidth(uint8_t) { spi(); }
+  void openReadingPipe(uint8_t, uint64_t) { spi(); }
+  void openWritingPipe(uint64_t) { spi(); }
+  void powerUp() { spi(); }
+  void powerDown() { spi(); }
+  void startListening() { spi(); }
+  void stopListening() { spi(); }
+  bool write(const void*, uint8_t len);
+  bool available() { spi(); return false; }
+  void read(void*, uint8_t) { spi(); }
+  rf24_crclength_e getCRCLength() { spi(); ++crcChecks; return crc; }
+
+  // mock state
+  rf24_crclength_e crc = RF24_CRC_16; // power-on default
+  unsigned begins = 0;
+  unsigned crcChecks = 0;
+  unsigned spiOps = 0;
+  unsigned packets = 0;
+
+private:
+  void spi();
+};
+
+#endif
@@ -0,0 +1,3 @@
+#ifndef MOCK_SPI_H
+#define MOCK_SPI_H
+#endif
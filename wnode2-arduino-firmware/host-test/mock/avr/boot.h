@@ -0,0 +1,8 @@
+#ifndef MOCK_AVR_BOOT_H
+#define MOCK_AVR_BOOT_H
+
+#include <stdint.h>
+
+uint8_t boot_signature_byte_get(uint8_t addr);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef MOCK_AVR_WDT_H
+#define MOCK_AVR_WDT_H
+
+#include <stdint.h>
+
+void wdt_enable(uint8_t timeout);
+void wdt_disable();
+
+#endif
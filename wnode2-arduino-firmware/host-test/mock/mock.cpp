@@ -0,0 +1,122 @@
+/*
+ * Host-side mock of the AVR peripherals
+ */
+
+#include "Arduino.h"
+#include "RF24.h"
+#include "avr/sleep.h"
+#include "avr/wdt.h"
+#include "avr/boot.h"
+#include "mock.h"
+
+volatile uint8_t ADMUX, ADCSRA, CLKPR, WDTCSR;
+volatile uint16_t ADC;
+volatile uint8_t TCCR1A, TCCR1B;
+volatile uint16_t TCNT1;
+MockSerial Serial;
+
+void WDT_vect(void); // defined by the sketch
+
+namespace mock {
+  uint32_t awakeUs;
+  uint32_t elapsedUs;
+  uint32_t stateUs[STATE_COUNT];
+  uint32_t adcConversions;
+  uint32_t wdtSleeps[10];
+  uint8_t signature[8] = {0x1E, 0, 0x95, 128, 0, 0, 0, 0}; // TS_GAIN 1.0, TS_OFFSET 0
+  uint16_t (*adcValue)(uint8_t admux);
+
+  static uint8_t sleepMode;
+  static bool sleepEnabled;
+  static int8_t wdtTimeout = -1;
+  static bool adcFirstConversion = true;
+
+  static uint16_t defaultAdcValue(uint8_t) { return 512; }
+
+  static void run(const state_t state, const uint32_t us) {
+    if(state == STATE_ACTIVE || state == STATE_RADIO_TX) awakeUs += us;
+    elapsedUs += us;
+    stateUs[state] += us;
+  }
+
+  static void awake(const uint32_t us) { run(STATE_ACTIVE, us); }
+
+  void reset() {
+    awakeUs = elapsedUs = adcConversions = 0;
+    memset(stateUs, 0, sizeof(stateUs));
+    memset(wdtSleeps, 0, sizeof(wdtSleeps));
+    adcValue = defaultAdcValue;
+    wdtTimeout = -1;
+    sleepEnabled = false;
+    Serial.calls = 0;
+  }
+
+  double chargeUC() {
+    double c = 0;
+    for(uint8_t i = 0; i < STATE_COUNT; ++i) c += double(stateUs[i]) * STATE_UA[i];
+    return c / 1e6;
+  }
+}
+
+using namespace mock;
+
+void cli() {}
+void sei() {}
+
+void pinMode(uint8_t, uint8_t) { awake(DIGITAL_IO_US); }
+void digitalWrite(uint8_t, uint8_t) { awake(DIGITAL_IO_US); }
+int digitalRead(uint8_t) { awake(DIGITAL_IO_US); return LOW; }
+int analogRead(uint8_t pin) { awake(ADC_CONVERSION_US); return pin * 37; }
+void delay(unsigned long ms) { awake(ms * 1000); }
+void delayMicroseconds(unsigned int us) { awake(us); }
+// the value is read at the start of the call
+unsigned long micros() { const uint32_t t = awakeUs; awake(MICROS_US); return t; }
+unsigned long millis() { const uint32_t t = awakeUs / 1000; awake(MICROS_US); return t; }
+
+void set_sleep_mode(uint8_t mode) { sleepMode = mode; }
+void sleep_enable() { sleepEnabled = true; }
+void sleep_disable() { sleepEnabled = false; }
+
+void sleep_cpu() {
+  if(!sleepEnabled) return;
+  if(sleepMode == SLEEP_MODE_ADC && (ADCSRA & _BV(ADSC))) {
+    // conversion completes, ADC interrupt wakes the CPU up
+    run(STATE_ADC_SLEEP, adcFirstConversion? ADC_FIRST_CONVERSION_US : ADC_CONVERSION_US);
+    adcFirstConversion = false;
+    ++adcConversions;
+    ADC = adcValue ? adcValue(ADMUX) : defaultAdcValue(ADMUX);
+    ADCSRA &= ~_BV(ADSC);
+    awake(ISR_WAKE_US);
+  } else if(sleepMode == SLEEP_MODE_PWR_DOWN && wdtTimeout >= 0) {
+    // watchdog interrupt wakes the CPU up
+    if(!(ADCSRA & _BV(ADEN))) adcFirstConversion = true;
+    run(STATE_POWER_DOWN, 16000UL << wdtTimeout);
+    ++wdtSleeps[wdtTimeout];
+    awake(ISR_WAKE_US);
+    WDT_vect();
+  }
+}
+
+void wdt_enable(uint8_t timeout) { wdtTimeout = timeout; }
+void wdt_disable() { wdtTimeout = -1; }
+
+uint8_t boot_signature_byte_get(uint8_t addr) { return signature[addr & 7]; }
+
+bool RF24::begin() {
+  ++begins;
+  for(uint8_t i = 0; i < 20; ++i) spi(); // register setup
+  crc = RF24_CRC_16;
+  return true;
+}
+
+bool RF24::write(const void*, uint8_t) {
+  spi();
+  ++packets;
+  run(STATE_RADIO_TX, RADIO_TX_US);
+  return true;
+}
+
+void RF24::spi() {
+  ++spiOps;
+  awake(SPI_OP_US);
+}
@@ -0,0 +1,39 @@
+/*
+ * Host-side mock state of the AVR peripherals
+ */
+
+#ifndef MOCK_MOCK_H
+#define MOCK_MOCK_H
+
+#include <stdint.h>
+
+namespace mock {
+  // 13 ADC clocks at F_CPU/64 (prescaler set by the Arduino core for 8MHz)
+  const uint32_t ADC_CONVERSION_US = 104;
+  const uint32_t ADC_FIRST_CONVERSION_US = 200; // 25 clocks: the first conversion after ADC enable
+  const uint32_t SPI_OP_US = 8;
+  const uint32_t RADIO_TX_US = 400; // write 32 bytes + PLL settle + air time at 1Mbps
+  // CPU time of the mocked calls; computations between them aren't modelled (avr_bench measures those on target)
+  const uint32_t DIGITAL_IO_US = 7;  // digitalWrite()/digitalRead()/pinMode() of the Arduino core, ~55 cycles
+  const uint32_t MICROS_US = 4;      // micros(), ~30 cycles
+  const uint32_t ISR_WAKE_US = 3;    // interrupt response, ISR and return after a wakeup
+
+  // where the time goes: MCU state (radio is powered down unless transmitting)
+  enum state_t { STATE_ACTIVE, STATE_ADC_SLEEP, STATE_POWER_DOWN, STATE_RADIO_TX, STATE_COUNT };
+  // supply current per state at 3V, typical values from the ATmega328P and nRF24L01+ datasheets:
+  // active at 8MHz, ADC noise reduction (idle + ADC), power-down with watchdog (+ radio power-down), active + TX at 0dBm
+  const uint32_t STATE_UA[STATE_COUNT] = {3300, 1100, 5, 3300 + 11300};
+
+  extern uint32_t awakeUs;          // what micros() returns: Timer0 stops in ADC and power-down sleep
+  extern uint32_t elapsedUs;        // real time, including sleep
+  extern uint32_t stateUs[STATE_COUNT];
+  extern uint32_t adcConversions;
+  extern uint32_t wdtSleeps[10];    // power-down sleeps by watchdog timeout
+  extern uint8_t signature[8];      // boot signature bytes (3 - TS_GAIN, 4 - TS_OFFSET)
+  extern uint16_t (*adcValue)(uint8_t admux); // conversion result for the selected channel
+
+  void reset();
+  double chargeUC();                // charge drawn since reset(), uC
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Runs setup() and a number of loop() wakeups of the sketch against the mock and checks
+ * what a single wakeup does: no radio reinit, no Serial, one watchdog sleep for WAKE_PERIOD_MS,
+ * active time the firmware accounts for matches the mock's. Reports charge drawn per wakeup.
+ */
+
+#include <stdio.h>
+#include "../wnode2-arduino-firmware.ino"
+#include "mock.h"
+
+static_assert(sizeof(WeatherNodeData) == 8, "data frame layout");
+static_assert(sizeof(TelemetryData) == 9, "telemetry frame layout");
+
+static unsigned fails = 0;
+#define CHECK(cond) do { if(!(cond)) { ++fails; printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while(0)
+
+static uint32_t accountedUs() {
+  uint32_t us = 0;
+  for(uint8_t i = 0; i < EnergyCounters::PHASE_COUNT; ++i) us += energy.activeUs[i];
+  return us;
+}
+
+static unsigned wdtSleepCount() {
+  unsigned n = 0;
+  for(uint8_t t = SLEEP_15MS; t <= SLEEP_8S; ++t) n += mock::wdtSleeps[t];
+  return n;
+}
+
+int main()
+{
+  mock::reset();
+  setup();
+  CHECK(radio.begins == 1);
+  CHECK(radio.crc == RF24_CRC_DISABLED);
+
+  // trace of a single wakeup
+  mock::reset();
+  const unsigned spiOps = radio.spiOps, packets = radio.packets;
+  const uint32_t accounted = accountedUs();
+  loop();
+  const uint32_t adcSleepUs = mock::stateUs[mock::STATE_ADC_SLEEP];
+  const uint32_t missedUs = mock::awakeUs + adcSleepUs - (accountedUs() - accounted);
+  printf("wakeup: active %luus (TX %luus), ADC sleep %luus (%lu conversions), %u SPI ops, %u packets, slept %lums\n",
+    (unsigned long)mock::awakeUs, (unsigned long)mock::stateUs[mock::STATE_RADIO_TX], (unsigned long)adcSleepUs, (unsigned long)mock::adcConversions,
+    radio.spiOps - spiOps, radio.packets - packets, (unsigned long)mock::stateUs[mock::STATE_POWER_DOWN] / 1000);
+  printf("wakeup: %.1fuC, %.1fuA average; active time not accounted by the firmware %luus\n",
+    mock::chargeUC(), mock::chargeUC() * 1e6 / mock::elapsedUs, (unsigned long)missedUs);
+  CHECK(mock::adcConversions == ADC_READ_CONVERSIONS);
+  // the firmware adds ADC_READ_US for the time micros() can't see
+  CHECK(adcSleepUs == ADC_READ_US);
+  // what's left is the wakeup from power-down and the way back to sleep
+  CHECK(mock::awakeUs + adcSleepUs >= accountedUs() - accounted);
+  CHECK(missedUs < 100);
+  CHECK(radio.packets - packets == 3);
+
+  // every wakeup
+  const unsigned WAKEUPS = 512;
+  radio.begins = radio.crcChecks = 0;
+  for(unsigned i = 0; i < WAKEUPS; ++i) {
+    mock::reset();
+    loop();
+    CHECK(Serial.calls == 0);
+    CHECK(wdtSleepCount() == 1 && mock::wdtSleeps[SLEEP_2S] == 1);
+  }
+  CHECK(radio.begins == 0);
+  CHECK(radio.crcChecks == WAKEUPS / 256);
+
+  // radio lost its configuration (e.g. brown-out): reinit at the next check only
+  radio.crc = RF24_CRC_16;
+  for(unsigned i = 0; i < 256; ++i) loop();
+  CHECK(radio.begins == 1);
+  CHECK(radio.crc == RF24_CRC_DISABLED);
+
+  printf("wake_trace_test: %s\n", fails? "FAIL" : "OK");
+  return fails? 1 : 0;
+}
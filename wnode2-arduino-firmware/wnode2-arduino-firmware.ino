@@ -1,6 +1,7 @@
 #include <SPI.h>
 #include <RF24.h>
 #include "BLE.h"
+#include "wnode_frame.h"
 #include <avr/sleep.h>
 #include <avr/wdt.h>
 
@@ -43,8 +44,21 @@
 #endif
 
 
+// def - debug output to Serial
+// ndef - no Serial at all (nothing is compiled in)
+//#define DEBUG_SERIAL
 #define DEBUG_BAUD 115200
 
+#ifdef DEBUG_SERIAL
+  #define DBG_PRINT(x) Serial.print(x)
+  #define DBG_PRINTLN(x) Serial.println(x)
+#else
+  #define DBG_PRINT(x) do {} while(0)
+  #define DBG_PRINTLN(x) do {} while(0)
+#endif
+
+#define WAKE_PERIOD_MS 2000 // chained from watchdog sleeps, 15ms resolution (WDT oscillator is +-10%)
+
 // def - DHT11
 // ndef - internal ATMEGA temperature
 //#define BEACON_DH11
@@ -56,9 +70,35 @@
 RF24 radio(RF24_CE_PIN, RF24_CSN_PIN);
 BTLE btle(&radio);
 
+// -- Fixed-point helpers --
+// readAdc() returns values with ADC_OVERSAMPLE_BITS extra bits (4^bits conversions per reading)
+#define ADC_OVERSAMPLE_BITS 2
+// 1.1V reference against AVcc: Vcc[mV] = VCC_ADC_K / ADC
+#define VCC_ADC_K (1125300L << ADC_OVERSAMPLE_BITS)
+// the highest ADC value that still means Vcc >= mv (folded at compile time)
+#define VCC_ADC_AT_MV(mv) (uint16_t)(VCC_ADC_K / (mv))
+
+// integer division rounding half away from zero (same as round(n/d))
+long divRound(const long n, const uint16_t d) {
+  return n < 0? -((-2*n + d) / (2*d)) : (2*n + d) / (2*d);
+}
+
 // -- Weather Node Data --
 #define BLE_DEVICE_NAME "wNode2" //max 6 chars
 #define UUID_TEMP2_HUM2 {0xA9, 0x53}
+#define UUID_TELEMETRY {0xA9, 0x54}
+#define TELEMETRY_EVERY_N_WAKEUPS 64 //send telemetry frame instead of data frame once in ~2 min
+
+// def - v2 frame: Service Data with TLV records, no name chunk
+// ndef - name + Manufacturer Data (v1)
+//#define BLE_FRAME_V2
+#ifdef BLE_FRAME_V2
+  #define BLE_ADV_NAME ""
+  #define BLE_ADV_DATA_TYPE 0x16 //Service Data - 16-bit UUID
+#else
+  #define BLE_ADV_NAME BLE_DEVICE_NAME
+  #define BLE_ADV_DATA_TYPE 0xFF //Manufacturer Specific Data
+#endif
 
 struct WeatherNodeData {
   enum battery_level_t {
@@ -82,10 +122,16 @@ struct WeatherNodeData {
   } flags;
   uint8_t reserve = 0;
 
-  static battery_level_t toBatteryLevel(const int volatage_mul_10) {
-    if(volatage_mul_10 > 30) return BATTERY_LEVEL_HIGH;
-    if(volatage_mul_10 > 28) return BATTERY_LEVEL_MED_HIGH;
-    if(volatage_mul_10 > 26) return BATTERY_LEVEL_MED_LOW;
+  bool hasHumidity() const {
+    const uint8_t* h = (const uint8_t*)&humidity;
+    return !(h[0] == 0x80 && h[1] == 0);
+  }
+
+  // vccAdc is a raw AdcReadings::vcc value (the lower ADC - the higher Vcc)
+  static battery_level_t toBatteryLevel(const uint16_t vccAdc) {
+    if(vccAdc <= VCC_ADC_AT_MV(3050)) return BATTERY_LEVEL_HIGH;    // > 3.0V
+    if(vccAdc <= VCC_ADC_AT_MV(2850)) return BATTERY_LEVEL_MED_HIGH;// > 2.8V
+    if(vccAdc <= VCC_ADC_AT_MV(2650)) return BATTERY_LEVEL_MED_LOW; // > 2.6V
     return BATTERY_LEVEL_LOW;
   }
 
@@ -96,35 +142,180 @@ private:
   }
 };
 
+// -- Energy accounting --
+// active time is measured with micros(), which doesn't advance while in power-down or ADC sleep (Timer0 is stopped),
+// so the ADC conversion time is added separately (ADC_READ_US)
+struct EnergyCounters {
+  enum phase_t { PHASE_SENSOR = 0, PHASE_RADIO = 1, PHASE_OTHER = 2, PHASE_COUNT };
+  static const uint8_t US_PER_UNIT = 16; //report unit
+
+  uint8_t wakeups = 0;
+  uint8_t txPackets = 0;
+  uint8_t sensorReads = 0;
+  uint8_t sensorFails = 0;
+  uint32_t activeUs[PHASE_COUNT] = {0};
+
+  //account active time since 'start' to the phase, returns current time
+  unsigned long account(const phase_t phase, const unsigned long start) {
+    const unsigned long now = micros();
+    activeUs[phase] += now - start;
+    return now;
+  }
+};
+
+//9 bytes (sent without flags chunk), counters are for the last telemetry window
+struct TelemetryData {
+  TelemetryData(const EnergyCounters& e) :
+    wakeups(e.wakeups), txPackets(e.txPackets), sensorReads(e.sensorReads), sensorFails(e.sensorFails)
+  {
+    for(uint8_t i = 0; i < EnergyCounters::PHASE_COUNT; ++i)
+      activeTime[i] = minifloat(e.activeUs[i] / EnergyCounters::US_PER_UNIT);
+  }
+
+  uint8_t uuid[2] = UUID_TELEMETRY;
+  uint8_t wakeups;
+  uint8_t txPackets;
+  uint8_t sensorReads;
+  uint8_t sensorFails;
+  uint8_t activeTime[3];  //total active time in the window, minifloat() of 16us units: sensor, radio, other
+
+private:
+  //8-bit float: exponent in bits 4-7, mantissa in bits 0-3, value = e? (16 + m) << (e - 1) : m (rounded down, max ~500k)
+  static uint8_t minifloat(uint32_t v) {
+    if(v < 16) return v;
+    uint8_t e = 1;
+    for(; v >= 32; v >>= 1) ++e;
+    return e > 15? 0xFF : (e << 4) | (v - 16);
+  }
+};
+
+EnergyCounters energy;
+
+// -- v2 frame --
+// TLV records as defined in wnode_frame.h
+static_assert(sizeof(TelemetryData) - 2 == WNODE_TLV_TELEMETRY_LEN, "telemetry record doesn't match the frame schema");
+
+struct FrameV2 {
+  FrameV2(const WeatherNodeData& d, const uint16_t vccMv) {
+    const uint8_t vcc[2] = {uint8_t(vccMv >> 8), uint8_t(vccMv)};
+    add(WNODE_TLV_STATUS, &d.flags, WNODE_TLV_STATUS_LEN);
+    add(WNODE_TLV_TEMPERATURE, &d.temperature, WNODE_TLV_TEMPERATURE_LEN);
+    if(d.hasHumidity()) add(WNODE_TLV_HUMIDITY, &d.humidity, WNODE_TLV_HUMIDITY_LEN);
+    add(WNODE_TLV_VCC, vcc, WNODE_TLV_VCC_LEN);
+  }
+  FrameV2(const TelemetryData& t) {
+    add(WNODE_TLV_TELEMETRY, &t.wakeups, WNODE_TLV_TELEMETRY_LEN);
+  }
+
+  bool add(const uint8_t type, const void* data, const uint8_t len) {
+    const uint8_t used = size - sizeof(uuid);
+    if(size_t(len) + 1 > sizeof(tlv) - used) return false;
+    uint8_t* rec = tlv + used;
+    *rec++ = WNODE_TLV_HEADER(type, len);
+    memcpy(rec, data, len);
+    size += 1 + len;
+    return true;
+  }
+
+  uint8_t uuid[2] = {WNODE_UUID16_V2 & 0xFF, WNODE_UUID16_V2 >> 8};
+  uint8_t tlv[WNODE_TLV_SPACE];
+  uint8_t size = sizeof(uuid); // bytes to send (UUID + TLV records)
+};
+
 // -------------------------
 
-long readVcc() 
+// -- ADC acquisition --
+// Conversions run in ADC noise reduction sleep (CPU and IO clocks are stopped), CPU is woken up by ADC interrupt.
+#define ADC_CLOCK_HZ (F_CPU / 64)  // prescaler set by the Arduino core: 125kHz at 8MHz
+#define ADC_CONVERSION_CLOCKS 13
+#define ADC_SETTLE_CONVERSIONS ((4000L * ADC_CLOCK_HZ / 1000000) / ADC_CONVERSION_CLOCKS) // ~4ms, wait for bandgap and Vref to settle
+#define ADC_SWITCH_CONVERSIONS 2  // discarded after channel switch
+#define ADC_MUX_INT_TEMP (_BV(REFS1) | _BV(REFS0) | _BV(MUX3))          // temperature sensor against 1.1V reference
+#define ADC_MUX_VCC (_BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1))    // 1.1V reference against AVcc
+
+struct AdcReadings {
+  uint16_t vcc;     // Vcc[mV] = VCC_ADC_K / vcc
+  uint16_t intTemp; // see intTempFromAdc()
+};
+
+EMPTY_INTERRUPT(ADC_vect);
+
+uint16_t adcConvert()
+{
+  ADCSRA |= _BV(ADIE) | _BV(ADSC);
+  set_sleep_mode(SLEEP_MODE_ADC);
+  sleep_enable();
+  for(;;) {
+    cli(); // so ADC interrupt can't fire between the check and sleep
+    if(bit_is_clear(ADCSRA, ADSC)) break;
+    sei(); // the next instruction is executed before any pending interrupt
+    sleep_cpu();
+  }
+  sei();
+  sleep_disable();
+  return ADC;
+}
+
+// 4^ADC_OVERSAMPLE_BITS conversions decimated to (10 + ADC_OVERSAMPLE_BITS) bits
+uint16_t adcOversample()
+{
+  uint16_t sum = 0;
+  for(uint8_t i = 0; i < (1 << 2*ADC_OVERSAMPLE_BITS); ++i) sum += adcConvert();
+  return sum >> ADC_OVERSAMPLE_BITS;
+}
+
+void adcDiscard(uint8_t n)
+{
+  while(n--) adcConvert();
+}
+
+// conversions done by readAdc()
+#ifndef BEACON_DH11
+  #define ADC_READ_CONVERSIONS (ADC_SETTLE_CONVERSIONS + ADC_SWITCH_CONVERSIONS + 2*(1 << 2*ADC_OVERSAMPLE_BITS))
+#else
+  #define ADC_READ_CONVERSIONS (ADC_SETTLE_CONVERSIONS + (1 << 2*ADC_OVERSAMPLE_BITS))
+#endif
+// time spent in ADC sleep by readAdc() (the first conversion after ADC enable takes 12 extra clocks)
+#define ADC_READ_US ((ADC_READ_CONVERSIONS * ADC_CONVERSION_CLOCKS + 12) * 1000000L / ADC_CLOCK_HZ)
+
+// Both channels depend on the bandgap, so it settles once for the pair.
+// Temperature goes first: switching Vref from 1.1V up to AVcc is quick, the opposite would wait for AREF to discharge.
+// ADMUX is left on the 1.1V reference, so AREF discharges while sleeping and the next temperature reading finds it settled.
+AdcReadings readAdc()
 {
-  long result;
-  // Read 1.1V reference against AVcc
-  ADMUX = _BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1);
-  delay(4); // Wait for Vref to settle
-  ADCSRA |= _BV(ADSC); // Convert
-  while (bit_is_set(ADCSRA,ADSC));
-  result = ADCL;
-  result |= ADCH<<8;
-  result = 1125300L / result; // calc AVcc in mV
-  return result;
+  AdcReadings r;
+#ifndef BEACON_DH11
+  ADMUX = ADC_MUX_INT_TEMP;
+  adcDiscard(ADC_SETTLE_CONVERSIONS);
+  r.intTemp = adcOversample();
+  ADMUX = ADC_MUX_VCC;
+  adcDiscard(ADC_SWITCH_CONVERSIONS);
+  r.vcc = adcOversample();
+  ADMUX = ADC_MUX_INT_TEMP;
+#else
+  ADMUX = ADC_MUX_VCC;
+  adcDiscard(ADC_SETTLE_CONVERSIONS);
+  r.vcc = adcOversample();
+#endif
+  ADCSRA &= ~_BV(ADIE);
+  return r;
 }
 
 // -------------------------
 #include <avr/boot.h>
-float readIntTemp() 
+// adc is AdcReadings::intTemp, tsOffset and tsGain are factory calibration bytes, returns temperature in 0.1 C
+int16_t intTempConvert(const uint16_t adc, const int8_t tsOffset, const uint8_t tsGain)
+{
+  // 25 + (ADC - (373 - tsOffset))*128/tsGain [C], scaled by 10 and rounded as a whole (the same ties as the float version)
+  const uint16_t d = uint16_t(tsGain) << ADC_OVERSAMPLE_BITS;
+  return divRound((long(adc) - (long(373 - tsOffset) << ADC_OVERSAMPLE_BITS))*(128*10) + 250L*d, d);
+}
+
+int16_t intTempFromAdc(const uint16_t adc) 
 {
   static const int8_t TS_OFFSET = boot_signature_byte_get(4);
   static const uint8_t TS_GAIN = boot_signature_byte_get(3);
-  
-  // Read temperature sensor against 1.1V reference
-  ADMUX = _BV(REFS1) | _BV(REFS0) | _BV(MUX3);
-  delay(4); // Wait for Vref to settle
-  ADCSRA |= _BV(ADSC); // Convert
-  while (bit_is_set(ADCSRA, ADSC));
-  return 25. + float(long( int(ADC) - (373 - TS_OFFSET) )*128) / TS_GAIN;
+  return intTempConvert(adc, TS_OFFSET, TS_GAIN);
 }
 
 // -------------------------
@@ -134,7 +325,7 @@ float readIntTemp()
 #define DHT_TIMEOUT   -2
 int temp1,temp10;
 int humidity = -1;
-float temperature;
+int16_t temperature; // 0.1 C
 
 int readDHT11(int pin)
 {
@@ -179,7 +370,7 @@ int readDHT11(int pin)
   humidity = bits[0];
   temp1    = bits[2];
   temp10   = bits[3];
-  temperature = abs(temp1+temp10/10.0);
+  temperature = temp1*10 + temp10;
 
   if(bits[4] != bits[0]+bits[1]+bits[2]+bits[3]) return DHT_CHECKSUM;
   return DHT_OK;
@@ -204,10 +395,6 @@ ISR(WDT_vect) { wdt_disable(); }
 
 void powerDown(uint8_t time)
 {
-  //turn off serial
-  Serial.flush();
-  Serial.end();
-  
   ADCSRA &= ~(1 << ADEN);  // turn off ADC
   if(time != SLEEP_FOREVER) { // use watchdog timer
     wdt_enable(time);
@@ -222,9 +409,26 @@ void powerDown(uint8_t time)
   // ... sleeping here
   sleep_disable();
   ADCSRA |= (1 << ADEN); // turn on ADC
+}
 
-  //turn on serial
+// sleep for ms (rounded down to 15ms) chaining the longest watchdog periods that fit
+void sleepFor(uint32_t ms)
+{
+  static const uint16_t wdtMs[] = {15, 30, 60, 120, 250, 500, 1000, 2000, 4000, 8000};
+
+#ifdef DEBUG_SERIAL
+  Serial.flush();
+  Serial.end();
+#endif
+  for(int8_t t = SLEEP_8S; t >= SLEEP_15MS; ) {
+    if(ms >= wdtMs[t]) {
+      powerDown(t);
+      ms -= wdtMs[t];
+    } else --t;
+  }
+#ifdef DEBUG_SERIAL
   Serial.begin(DEBUG_BAUD);
+#endif
 }
 // -------------------------
 
@@ -245,46 +449,87 @@ void setup()
 #endif
 
   pinMode(LED_BUILTIN, OUTPUT);
+#ifdef DEBUG_SERIAL
   Serial.begin(DEBUG_BAUD);
-  btle.begin(BLE_DEVICE_NAME);
+#endif
+  btle.begin(BLE_ADV_NAME);
   btle.setMAC(randByte(),randByte(),randByte(),randByte(),randByte(),randByte() | 0xC0);
 }
 
+// -------------------------
+
+void sendPacket(void* data, uint8_t size)
+{
+  radio.powerUp();
+  for(uint8_t i = 0; i < 3; ++i) {
+    // txPackets counts packets handed to the radio, advertise() fails only if the frame can't be built
+    if(btle.advertise(BLE_ADV_DATA_TYPE, data, size)) ++energy.txPackets;
+    else DBG_PRINTLN(F("Send fail!"));
+    btle.hopChannel();
+  }
+  radio.powerDown();
+}
+
 // -------------------------
 bool sensorFailFlag = false;
-uint8_t bleReinitCnt = 0;
+uint8_t radioCheckCnt = 0;
 void loop() 
 {
-  //reinit radio periodically
-  if(bleReinitCnt == 0) btle.begin(BLE_DEVICE_NAME);
-  ++bleReinitCnt;
+  unsigned long t = micros();
+  ++energy.wakeups;
+
+  //radio keeps its configuration in power-down, check it periodically and reinit only if it's been lost (e.g. brown-out)
+  if(radioCheckCnt == 0 && radio.getCRCLength() != RF24_CRC_DISABLED) btle.begin(BLE_ADV_NAME);
+  ++radioCheckCnt;
+  t = energy.account(EnergyCounters::PHASE_RADIO, t);
   
   digitalWrite(LED_BUILTIN, HIGH);
 
   //get readings
-  long v = readVcc();
-  Serial.print("Batt: "); Serial.println(v/1000.0);
-
+  const AdcReadings adc = readAdc();
+  ++energy.sensorReads;
 #ifdef BEACON_DH11
   sensorFailFlag = readDHT11(DHT11_PIN) != DHT_OK;
-  if(sensorFailFlag) Serial.println("DHT11 error!");
+  if(sensorFailFlag) ++energy.sensorFails;
 #else
-  temperature = readIntTemp();
+  temperature = intTempFromAdc(adc.intTemp);
 #endif
-  Serial.print(F("Temp: ")); Serial.println(temperature);
+  t = energy.account(EnergyCounters::PHASE_SENSOR, t);
+  energy.activeUs[EnergyCounters::PHASE_SENSOR] += ADC_READ_US;
 
-  //prepare packet
-  WeatherNodeData wnData(round(temperature*10), humidity < 0? INT16_MIN : humidity, sensorFailFlag, WeatherNodeData::toBatteryLevel(round(v/100.)));
+  DBG_PRINT(F("Batt: ")); DBG_PRINT(VCC_ADC_K / adc.vcc); DBG_PRINTLN(F("mV"));
+  if(sensorFailFlag) DBG_PRINTLN(F("DHT11 error!"));
+  DBG_PRINT(F("Temp: ")); if(temperature < 0) DBG_PRINT('-');
+  DBG_PRINT(abs(temperature)/10); DBG_PRINT('.'); DBG_PRINTLN(abs(temperature)%10);
 
-  //send packet
-  radio.powerUp();
-  for(uint8_t i = 0; i < 3; ++i) {
-    if(!btle.advertise(&wnData, sizeof(wnData))) Serial.println("Send fail!");
-    btle.hopChannel();
+  //prepare packet
+  WeatherNodeData wnData(temperature, humidity < 0? INT16_MIN : humidity, sensorFailFlag, WeatherNodeData::toBatteryLevel(adc.vcc));
+
+  //send packet (telemetry frame goes in place of the data frame)
+  if(energy.wakeups >= TELEMETRY_EVERY_N_WAKEUPS) {
+    TelemetryData telemetry(energy);
+    energy = EnergyCounters();
+    t = energy.account(EnergyCounters::PHASE_OTHER, t);
+#ifdef BLE_FRAME_V2
+    FrameV2 frame(telemetry);
+    sendPacket(&frame, frame.size);
+#else
+    sendPacket(&telemetry, sizeof(telemetry));
+#endif
+  } else {
+#ifdef BLE_FRAME_V2
+    FrameV2 frame(wnData, VCC_ADC_K / adc.vcc);
+    t = energy.account(EnergyCounters::PHASE_OTHER, t);
+    sendPacket(&frame, frame.size);
+#else
+    t = energy.account(EnergyCounters::PHASE_OTHER, t);
+    sendPacket(&wnData, sizeof(wnData));
+#endif
   }
-  radio.powerDown();
+  t = energy.account(EnergyCounters::PHASE_RADIO, t);
 
   //power down and sleep
   digitalWrite(LED_BUILTIN, LOW);
-  powerDown(SLEEP_2S);
+  energy.account(EnergyCounters::PHASE_OTHER, t);
+  sleepFor(WAKE_PERIOD_MS);
 }
@@ -0,0 +1,39 @@
+/*
+ * Weather Node v2 frame schema, shared by both firmwares and checked against the station app decoder
+ * (wnodestation-app/__tests__/FrameSchema-test.ts).
+ * It lives in the sketch folder because the Arduino IDE can't include files from outside of it,
+ * wnode1 gets it through the include path in wnode.cbp.
+ * Plain C: SDCC (wnode1) and avr-g++ (wnode2).
+ */
+
+#ifndef WNODE_FRAME_H
+#define WNODE_FRAME_H
+
+//Service Data - 16-bit UUID, little-endian on air
+#define WNODE_UUID16_V2 0xA953
+
+//TLV record header: type in high nibble, data length in low nibble
+#define WNODE_TLV_HEADER(type, len) (((type) << 4) | (len))
+//21 - flags chunk(3) - service data chunk header(2) - UUID(2)
+#define WNODE_TLV_SPACE 14
+
+//record types and data lengths; a decoder skips unknown types and reads known ones up to their length
+#define WNODE_TLV_STATUS            0x1 //flags: battery level (bits 0-1), sensor fail (bit 2)
+#define WNODE_TLV_STATUS_LEN        1
+#define WNODE_TLV_TEMPERATURE       0x2 //DHT22 format (sign bit + 0.1C, big-endian), repeats for several probes
+#define WNODE_TLV_TEMPERATURE_LEN   2
+#define WNODE_TLV_HUMIDITY          0x3 //DHT22 format (0.1%), 0x8000 - no humidity sensor
+#define WNODE_TLV_HUMIDITY_LEN      2
+#define WNODE_TLV_PRESSURE          0x4 //0.1 hPa, big-endian
+#define WNODE_TLV_PRESSURE_LEN      2
+#define WNODE_TLV_VCC               0x5 //mV, big-endian
+#define WNODE_TLV_VCC_LEN           2
+#define WNODE_TLV_TELEMETRY         0x6 //wakeups, tx packets, sensor reads, sensor fails, active time (minifloat) x3
+#define WNODE_TLV_TELEMETRY_LEN     7
+#define WNODE_TLV_AUTH_DATA         0x7 //humidity, temperature (as above), status flags, counter (24 bit, big-endian), MIC; goes last
+#define WNODE_TLV_AUTH_DATA_LEN     12
+#define WNODE_AUTH_MIC_LEN          4   //AES-CMAC with the node key over the service data before the MIC, truncated
+#define WNODE_TLV_SCHEDULE          0x8 //TX period in ms (big-endian); a frame goes out at the start of each period, its arrival is the phase
+#define WNODE_TLV_SCHEDULE_LEN      2
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @format
+ */
+
+import { energyCsv, formatEnergyProfile } from '../weatherNodeStation/EnergyReport';
+import { WeatherNode, EnergyProfile } from '../weatherNodeStation/SensorListScreen';
+
+const energy: EnergyProfile = {
+  wakeups: 64,
+  txPackets: 192,
+  sensorReads: 1,
+  sensorFailures: 0,
+  activeMsPerWindow: { sensor: 8, radio: 40, other: 16 },
+  updated: 'upd'
+};
+const node = (mac: string, e?: EnergyProfile): WeatherNode =>
+  ({ mac, name: 'wNode1', temperature: 20, updated: 'upd', energy: e });
+
+it('formats energy profile', () => {
+  expect(formatEnergyProfile(energy)).toBe('64 wakeups, 192 TX, 1 reads (0 failed), active 1.00 ms/wakeup');
+});
+
+it('exports nodes with telemetry as CSV', () => {
+  const csv = energyCsv(
+    { a: node('AA', energy), b: node('BB') },
+    { AA: 'Garden, "north"' }
+  ).split('\n');
+  expect(csv).toEqual([
+    'mac,name,updated,wakeups,tx_packets,sensor_reads,sensor_failures,sensor_ms,radio_ms,other_ms',
+    'AA,"Garden, ""north""",upd,64,192,1,0,8,40,16'
+  ]);
+});
@@ -0,0 +1,23 @@
+/**
+ * @format
+ */
+
+import { WNODE_FRAME } from '../weatherNodeStation/WeatherNodeDecoder';
+
+const fs = require('fs');
+const path = require('path');
+
+//object-like #define WNODE_<NAME> <number> from the firmware header
+const readSchemaHeader = () => {
+  const header: string = fs.readFileSync(path.join(__dirname, '../../wnode2-arduino-firmware/wnode_frame.h'), 'utf8');
+  const schema: Record<string, number> = {};
+  const re = /^#define\s+WNODE_(\w+)\s+(0x[0-9a-f]+|\d+)\b/gim;
+  for(let m = re.exec(header); m; m = re.exec(header)) schema[m[1]] = Number(m[2]);
+  return schema;
+};
+
+it('matches the firmware frame schema', () => {
+  const schema = readSchemaHeader();
+  expect(Object.keys(schema).length).toBeGreaterThan(0);
+  expect(WNODE_FRAME).toEqual(schema);
+});
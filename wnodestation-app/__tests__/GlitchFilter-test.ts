@@ -0,0 +1,64 @@
+/**
+ * @format
+ */
+
+import { GlitchFilter } from '../weatherNodeStation/GlitchFilter';
+
+const POLL_MS = 120000;   //node polls the sensor every 2 min
+const ADVERT_MS = 2000;   //and repeats the reading in every advert
+
+//feeds each reading the way the scanner sees it, returns the filter output at the end of each poll
+const feedPolls = (filter: GlitchFilter, readings: number[]) => {
+  let now = 0;
+  return readings.map(v => {
+    let out = filter.filter('node', v, now);
+    for(let t = ADVERT_MS; t < POLL_MS; t += ADVERT_MS) out = filter.filter('node', v, now + t);
+    now += POLL_MS;
+    return out;
+  });
+};
+
+const params = { minDeviation: 1, maxRatePerMin: 2 };
+
+it('accepts everything while warming up', () => {
+  const filter = new GlitchFilter(params);
+  expect(filter.filter('node', 10, 0)).toEqual({ value: 10, rejected: false });
+  expect(filter.filter('node', 30, 1000)).toEqual({ value: 30, rejected: false });
+  expect(filter.filter('node', 50, 2000)).toEqual({ value: 50, rejected: false });
+  expect(filter.filter('node', 90, 3000)).toEqual({ value: 50, rejected: true });
+});
+
+it('rejects a single spike', () => {
+  const out = feedPolls(new GlitchFilter(params), [40, 41, 40, 41, 40, 60, 40, 41]);
+  expect(out[5]).toEqual({ value: 40, rejected: true });
+  expect(out.map(o => o.value)).toEqual([40, 41, 40, 41, 40, 40, 40, 41]);
+});
+
+it('accepts a step to a constant value once it persists', () => {
+  const out = feedPolls(new GlitchFilter(params), [40, 41, 40, 41, 40, ...Array(11).fill(60)]);
+  expect(out[5].rejected).toBe(true);
+  expect(out[6]).toEqual({ value: 60, rejected: false });
+  expect(out.slice(6).every(o => o.value === 60 && !o.rejected)).toBe(true);
+});
+
+it('keeps raw and filtered history', () => {
+  const filter = new GlitchFilter(params, 4);
+  feedPolls(filter, [40, 41, 40, 41, 40, 60]);
+  const history = filter.history('node');
+  expect(history.length).toBe(4);
+  expect(history.every((h, i) => i === 0 || h.time > history[i - 1].time)).toBe(true);
+  expect(history[0]).toMatchObject({ raw: 40, filtered: 40, rejected: false });
+  const spike = filter.history('node', 5 * POLL_MS);
+  expect(spike[0]).toEqual({ time: 5 * POLL_MS, raw: 60, filtered: 40, rejected: true });
+  expect(filter.history('other')).toEqual([]);
+});
+
+it('evicts stale channels', () => {
+  const filter = new GlitchFilter(params);
+  filter.filter('old', 10, 0);
+  filter.filter('new', 20, 10000);
+  filter.evict(5000);
+  expect(filter.history('old')).toEqual([]);
+  expect(filter.history('new').length).toBe(1);
+  expect(filter.filter('old', 90, 20000)).toEqual({ value: 90, rejected: false });
+});
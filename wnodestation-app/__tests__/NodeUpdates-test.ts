@@ -0,0 +1,80 @@
+/**
+ * @format
+ */
+
+import { mergeNodeUpdates, createUpdateBatcher, sortNodes } from '../weatherNodeStation/NodeUpdates';
+import { WeatherNode, EnergyProfile } from '../weatherNodeStation/SensorListScreen';
+import { NodeUpdate } from '../weatherNodeStation/WeatherNodeDecoder';
+
+const node = (mac: string, updated: string, temperature = 20): WeatherNode =>
+  ({ mac, name: 'wNode1', temperature, updated });
+
+const energy: EnergyProfile = {
+  wakeups: 64,
+  txPackets: 192,
+  sensorReads: 1,
+  sensorFailures: 0,
+  activeMsPerWindow: { sensor: 8, radio: 40, other: 16 },
+  updated: 'upd'
+};
+
+it('merges updates into nodes', () => {
+  const nodes = { AA: node('AA', 'upd1') };
+  const res = mergeNodeUpdates(nodes, { AA: { mac: 'AA', temperature: 21 }, BB: { mac: 'BB', temperature: 5, updated: 'upd2' } });
+  expect(res.AA).toEqual({ ...nodes.AA, temperature: 21 });
+  expect(res.BB).toEqual({ mac: 'BB', temperature: 5, updated: 'upd2' });
+  expect(nodes.AA.temperature).toBe(20);
+});
+
+it('attaches telemetry only to known nodes', () => {
+  const res = mergeNodeUpdates({ AA: node('AA', 'upd') }, { AA: { mac: 'AA', energy }, BB: { mac: 'BB', energy } });
+  expect(res.AA.energy).toEqual(energy);
+  expect(res.BB).toBeUndefined();
+});
+
+describe('update batcher', () => {
+  beforeEach(() => jest.useFakeTimers());
+  afterEach(() => jest.useRealTimers());
+
+  it('coalesces updates by MAC, one batch per interval', () => {
+    const batches: Record<string, NodeUpdate>[] = [];
+    const batcher = createUpdateBatcher(b => batches.push(b), 250);
+    batcher.push({ mac: 'AA', temperature: 20 });
+    batcher.push({ mac: 'BB', temperature: 10 });
+    batcher.push({ mac: 'AA', energy });
+    batcher.push({ mac: 'AA', temperature: 21 });
+    jest.advanceTimersByTime(249);
+    expect(batches.length).toBe(0);
+    jest.advanceTimersByTime(1);
+    expect(batches).toEqual([{ AA: { mac: 'AA', temperature: 21, energy }, BB: { mac: 'BB', temperature: 10 } }]);
+    jest.advanceTimersByTime(1000);
+    expect(batches.length).toBe(1);
+  });
+
+  it('hands pending updates over on flush', () => {
+    const batches: Record<string, NodeUpdate>[] = [];
+    const batcher = createUpdateBatcher(b => batches.push(b), 250);
+    batcher.flush();
+    expect(batches.length).toBe(0);
+    batcher.push({ mac: 'AA', temperature: 20 });
+    batcher.flush();
+    expect(batches).toEqual([{ AA: { mac: 'AA', temperature: 20 } }]);
+    jest.advanceTimersByTime(1000);
+    expect(batches.length).toBe(1);
+  });
+});
+
+it('sorts by minute, most recent first, then by name', () => {
+  const t0 = new Date(2020, 4, 1, 12, 0, 0).getTime();
+  const at = (ms: number) => new Date(t0 + ms).toString();
+  const nodes = {
+    AA: node('AA', at(0)),
+    BB: node('BB', at(10000)),
+    CC: node('CC', at(120000)),
+    DD: node('DD', at(5000))
+  };
+  const names = { BB: 'attic', DD: 'Garden' };
+  expect(sortNodes(nodes, names).map(n => n.mac)).toEqual(['CC', 'AA', 'BB', 'DD']);
+  expect(sortNodes(nodes, {}).map(n => n.mac)).toEqual(['CC', 'AA', 'BB', 'DD']);
+  expect(sortNodes(nodes, { AA: 'zz' }).map(n => n.mac)).toEqual(['CC', 'BB', 'DD', 'AA']);
+});
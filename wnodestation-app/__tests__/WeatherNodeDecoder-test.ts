@@ -0,0 +1,72 @@
+/**
+ * @format
+ */
+
+import { Device as BleDevice } from 'react-native-ble-plx';
+import { Buffer } from 'buffer';
+import { decodeWeatherNode } from '../weatherNodeStation/WeatherNodeDecoder';
+
+//v2 frames as built by BLE_set_service_data (wnode1) and FrameV2 (wnode2); ble-plx strips the UUID
+const tlv = (type: number, ...data: number[]) => [(type << 4) | data.length, ...data];
+const v2Device = (...records: number[][]) => ({
+  id: '00:11:22:33:44:55',
+  name: null,
+  manufacturerData: null,
+  serviceData: { '0000a953-0000-1000-8000-00805f9b34fb': Buffer.from(([] as number[]).concat(...records)).toString('base64') }
+} as unknown as BleDevice);
+
+it('decodes status, temperature, humidity and Vcc', () => {
+  const update = decodeWeatherNode(v2Device(
+    tlv(0x1, 0x02 | 0x04),  //battery medium-low, sensor failure
+    tlv(0x2, 0x80, 0x7B),   //-12.3C
+    tlv(0x3, 0x01, 0xC8),   //45.6%
+    tlv(0x5, 0x0B, 0x86),   //2950mV
+    tlv(0x8, 0x06, 0xD6)    //TX every 1750ms, for the gateway scan scheduler
+  ));
+  expect(update).toMatchObject({
+    mac: '00:11:22:33:44:55',
+    temperature: -12.3,
+    humidity: 45.6,
+    vcc: 2.95,
+    batteryLevel: 'medium-low',
+    error: 'sensor failure'
+  });
+  expect(update?.probes).toBeUndefined();
+});
+
+it('decodes telemetry record', () => {
+  const update = decodeWeatherNode(v2Device(
+    tlv(0x6, 64, 192, 64, 1, 0x5A, 0x00, 0x1F)
+  ));
+  expect(update?.temperature).toBeUndefined();
+  expect(update?.energy).toMatchObject({
+    wakeups: 64,
+    txPackets: 192,
+    sensorReads: 64,
+    sensorFailures: 1
+  });
+  expect(update?.energy?.activeMsPerWindow.sensor).toBeCloseTo(26 * 16 * 0.016);
+  expect(update?.energy?.activeMsPerWindow.radio).toBe(0);
+  expect(update?.energy?.activeMsPerWindow.other).toBeCloseTo(31 * 0.016);
+});
+
+it('skips unknown record types', () => {
+  const update = decodeWeatherNode(v2Device(
+    tlv(0xE, 0xAA, 0xBB, 0xCC),
+    tlv(0x2, 0x00, 0xFA),   //25.0C
+    tlv(0x3, 0x80, 0x00)    //no humidity
+  ));
+  expect(update?.temperature).toBe(25);
+  expect(update?.humidity).toBeUndefined();
+});
+
+it('decodes authenticated data record without checking MIC', () => {
+  const update = decodeWeatherNode(v2Device(
+    tlv(0x7, 0x01, 0xC8, 0x00, 0xFA, 0x01, 0x00, 0x01, 0x02, 0xDE, 0xAD, 0xBE, 0xEF)  //45.6%, 25.0C, medium-high, counter 258, MIC
+  ));
+  expect(update).toMatchObject({ temperature: 25, humidity: 45.6, batteryLevel: 'medium-high' });
+});
+
+it('rejects truncated record', () => {
+  expect(decodeWeatherNode(v2Device(tlv(0x1, 0x00), [0x22, 0x00]))).toBeUndefined();
+});
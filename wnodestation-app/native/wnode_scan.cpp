@@ -0,0 +1,177 @@
+/*
+ * Weather Node Station
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+#include "wnode_scan.h"
+#include <string.h>
+#include <algorithm>
+#include "wnode_frame.h" // wnode2-arduino-firmware/, on the include path
+
+namespace wnode {
+
+// AD structure types
+static const uint8_t AD_NAME_SHORT = 0x08;
+static const uint8_t AD_NAME = 0x09;
+static const uint8_t AD_SERVICE_DATA16 = 0x16;
+static const uint8_t AD_MANUF_DATA = 0xFF;
+
+// DHT22 format: sign bit + 0.1 units, big-endian; 0x8000 - inactive channel
+static int16_t dht22(const uint8_t* b) {
+  if(b[0] == 0x80 && b[1] == 0) return NO_VALUE;
+  const int16_t v = int16_t(((b[0] & 0x7F) << 8) | b[1]);
+  return (b[0] & 0x80)? -v : v;
+}
+
+static uint16_t be16(const uint8_t* b) { return uint16_t((b[0] << 8) | b[1]); }
+
+static void decodeTelemetry(const uint8_t* b, Telemetry& t) {
+  t.wakeups = b[0];
+  t.txPackets = b[1];
+  t.sensorReads = b[2];
+  t.sensorFails = b[3];
+  memcpy(t.activeTime, b + 4, sizeof(t.activeTime));
+}
+
+// e = bits 4-7, m = bits 0-3, value = e == 0 ? m : (16 + m) << (e - 1)
+uint32_t Telemetry::activeUs(const uint8_t v) {
+  const uint8_t e = v >> 4, m = v & 0xF;
+  return (e? uint32_t(16 + m) << (e - 1) : m) * 16;
+}
+
+void Reading::merge(const Reading& r) {
+  timeMs = r.timeMs;
+  fields |= r.fields;
+  if(r.fields & HAS_DATA) {
+    status = r.status;
+    temperature = r.temperature;
+    humidity = r.humidity;
+  }
+  if(r.fields & HAS_PRESSURE) pressure = r.pressure;
+  if(r.fields & HAS_VCC) vccMv = r.vccMv;
+  if(r.fields & HAS_TELEMETRY) telemetry = r.telemetry;
+  if(r.fields & HAS_SCHEDULE) periodMs = r.periodMs;
+}
+
+static bool decodeV1(const uint8_t* b, const uint8_t len, Reading& r) {
+  if(len < 8 || b[0] != 0xA9) return false;
+  if(b[1] == 0x54) {
+    if(len < 2 + WNODE_TLV_TELEMETRY_LEN) return false;
+    decodeTelemetry(b + 2, r.telemetry);
+    r.fields = Reading::HAS_TELEMETRY;
+    return true;
+  }
+  if(b[1] != 0x53) return false;
+  r.humidity = dht22(b + 2);
+  r.temperature = dht22(b + 4);
+  r.status = b[6];
+  r.fields = Reading::HAS_DATA;
+  return true;
+}
+
+// a list of TLV records, unknown types are skipped
+static bool decodeV2(const uint8_t* b, const uint8_t len, Reading& r) {
+  bool temperature = false;
+  for(uint8_t i = 0; i < len; ) {
+    const uint8_t type = b[i] >> 4, n = b[i] & 0xF;
+    const uint8_t* d = b + i + 1;
+    i += 1 + n;
+    if(i > len) return false;
+    if(type == WNODE_TLV_STATUS && n >= WNODE_TLV_STATUS_LEN) r.status = d[0];
+    else if(type == WNODE_TLV_TEMPERATURE && n >= WNODE_TLV_TEMPERATURE_LEN) {
+      if(!temperature) r.temperature = dht22(d); // the first probe
+      temperature = true;
+    }
+    else if(type == WNODE_TLV_HUMIDITY && n >= WNODE_TLV_HUMIDITY_LEN) r.humidity = dht22(d);
+    else if(type == WNODE_TLV_PRESSURE && n >= WNODE_TLV_PRESSURE_LEN) {
+      r.pressure = be16(d);
+      r.fields |= Reading::HAS_PRESSURE;
+    }
+    else if(type == WNODE_TLV_VCC && n >= WNODE_TLV_VCC_LEN) {
+      r.vccMv = be16(d);
+      r.fields |= Reading::HAS_VCC;
+    }
+    else if(type == WNODE_TLV_TELEMETRY && n >= WNODE_TLV_TELEMETRY_LEN) {
+      decodeTelemetry(d, r.telemetry);
+      r.fields |= Reading::HAS_TELEMETRY;
+    }
+    else if(type == WNODE_TLV_SCHEDULE && n >= WNODE_TLV_SCHEDULE_LEN) {
+      r.periodMs = be16(d);
+      r.fields |= Reading::HAS_SCHEDULE;
+    }
+    else if(type == WNODE_TLV_AUTH_DATA && n >= WNODE_TLV_AUTH_DATA_LEN) { // MIC is checked by the gateway, which has the keys
+      r.humidity = dht22(d);
+      if(!temperature) r.temperature = dht22(d + 2);
+      r.status = d[4];
+      temperature = true;
+    }
+  }
+  if(temperature) r.fields |= Reading::HAS_DATA;
+  return r.fields != 0;
+}
+
+bool decodeAdvert(const uint8_t* adv, const size_t len, const uint64_t mac, const uint32_t timeMs, Reading& out) {
+  const uint8_t* manuf = nullptr;
+  uint8_t manufLen = 0;
+  bool named = false;
+  for(size_t i = 0; i < len; ) {
+    const uint8_t n = adv[i]; // type + data
+    if(n == 0) break;         // the rest is padding
+    if(i + 1 + n > len) return false;
+    const uint8_t type = adv[i + 1];
+    const uint8_t* d = adv + i + 2;
+    const uint8_t dlen = n - 1;
+    i += 1 + n;
+    if(type == AD_SERVICE_DATA16 && dlen >= 2 && (d[0] | (d[1] << 8)) == WNODE_UUID16_V2) {
+      Reading r;
+      if(!decodeV2(d + 2, dlen - 2, r)) return false;
+      r.mac = mac;
+      r.timeMs = timeMs;
+      out = r;
+      return true;
+    }
+    if((type == AD_NAME || type == AD_NAME_SHORT) && dlen >= 5 && !memcmp(d, "wNode", 5)) named = true;
+    if(type == AD_MANUF_DATA) {
+      manuf = d;
+      manufLen = dlen;
+    }
+  }
+  Reading r;
+  if(!named || !manuf || !decodeV1(manuf, manufLen, r)) return false;
+  r.mac = mac;
+  r.timeMs = timeMs;
+  out = r;
+  return true;
+}
+
+static bool macLess(const Reading& r, const uint64_t mac) { return r.mac < mac; }
+
+void Coalescer::push(const Reading& r) {
+  const auto it = std::lower_bound(readings.begin(), readings.end(), r.mac, macLess);
+  if(it != readings.end() && it->mac == r.mac) it->merge(r);
+  else readings.insert(it, r);
+}
+
+bool Coalescer::due(const uint32_t nowMs) const {
+  return !readings.empty() && (!batchTaken || nowMs - lastBatchMs >= intervalMs);
+}
+
+size_t Coalescer::take(const uint32_t nowMs, std::vector<Reading>& batch) {
+  if(due(nowMs)) return flush(nowMs, batch);
+  batch.clear();
+  return 0;
+}
+
+size_t Coalescer::flush(const uint32_t nowMs, std::vector<Reading>& batch) {
+  batch.clear();
+  if(readings.empty()) return 0;
+  batch.swap(readings);
+  readings.clear();
+  lastBatchMs = nowMs;
+  batchTaken = true;
+  return batch.size();
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+ * Weather Node Station
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+ * Scan decoding core: decodes Weather Node adverts (raw advertising data, see readme) into a compact struct
+ * and coalesces them by MAC into batches handed over at most once per interval, in a stable order (by MAC).
+ * Plain C++11 without platform dependencies, so the same code can sit behind a JSI binding of the app
+ * and builds with its tests on the host (make test).
+ */
+
+#ifndef WNODE_SCAN_H
+#define WNODE_SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace wnode {
+
+// 0.1 units like DHT22, INT16_MIN - no value
+const int16_t NO_VALUE = INT16_MIN;
+
+struct Telemetry {
+  uint8_t wakeups;
+  uint8_t txPackets;
+  uint8_t sensorReads;
+  uint8_t sensorFails;
+  uint8_t activeTime[3];  // minifloat of 16us units: sensor, radio, other
+
+  static uint32_t activeUs(uint8_t v);
+};
+
+struct Reading {
+  enum field_t : uint8_t {
+    HAS_DATA = 1,       // temperature, humidity, status
+    HAS_PRESSURE = 2,
+    HAS_VCC = 4,
+    HAS_TELEMETRY = 8,
+    HAS_SCHEDULE = 16
+  };
+
+  uint64_t mac = 0;     // 48 bits, as the scanner reports it
+  uint32_t timeMs = 0;  // when the last advert merged into this reading has been received
+  uint8_t fields = 0;
+  uint8_t status = 0;   // battery level (bits 0-1), sensor fail (bit 2)
+  int16_t temperature = NO_VALUE;  // 0.1C, the first probe
+  int16_t humidity = NO_VALUE;     // 0.1%
+  uint16_t pressure = 0;           // 0.1 hPa
+  uint16_t vccMv = 0;
+  uint16_t periodMs = 0;           // advertised TX period, the advert is sent at the start of it
+  Telemetry telemetry = {};
+
+  // takes the fields present in 'r' (and its time)
+  void merge(const Reading& r);
+};
+
+// Decodes AD structures of an advert: a v1 node is recognized by "wNode" name and manufacturer data
+// with UUID 0xA9 0x53 (data) or 0xA9 0x54 (telemetry), a v2 node by service data with WNODE_UUID16_V2.
+// Returns false if it's not a Weather Node advert or it's malformed.
+bool decodeAdvert(const uint8_t* adv, size_t len, uint64_t mac, uint32_t timeMs, Reading& out);
+
+class Coalescer {
+public:
+  explicit Coalescer(uint32_t intervalMs) : intervalMs(intervalMs) {}
+
+  void push(const Reading& r);
+  // a batch can be taken: something's pending and the interval since the last batch has passed
+  bool due(uint32_t nowMs) const;
+  // moves pending readings to 'batch' sorted by MAC, returns their number; flush() takes them regardless of the interval
+  size_t take(uint32_t nowMs, std::vector<Reading>& batch);
+  size_t flush(uint32_t nowMs, std::vector<Reading>& batch);
+  size_t pending() const { return readings.size(); }
+
+private:
+  const uint32_t intervalMs;
+  uint32_t lastBatchMs = 0;
+  bool batchTaken = false;
+  std::vector<Reading> readings;  // sorted by MAC
+};
+
+}
+
+#endif
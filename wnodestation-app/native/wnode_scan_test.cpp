@@ -0,0 +1,116 @@
+/*
+ * Decodes adverts the way both firmwares build them and checks coalescing and batching of the readings
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "wnode_scan.h"
+#include "wnode_frame.h"
+
+using namespace wnode;
+
+static unsigned fails = 0;
+#define CHECK(cond) do { if(!(cond)) { ++fails; printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while(0)
+
+// flags chunk, name chunk, manufacturer data: UUID, humidity, temperature, flags, reserved
+static const uint8_t V1_DATA[] = {
+  2, 0x01, 0x05,
+  6, 0x09, 'w', 'N', 'o', 'd', 'e',
+  9, 0xFF, 0xA9, 0x53, 0x01, 0xC2, 0x80, 0x7B, 0x01, 0x00
+};
+// telemetry goes without flags chunk
+static const uint8_t V1_TELEMETRY[] = {
+  6, 0x09, 'w', 'N', 'o', 'd', 'e',
+  10, 0xFF, 0xA9, 0x54, 64, 192, 1, 0, 0x12, 0x34, 0x05
+};
+// service data: UUID (little-endian), status, temperature x2, humidity, vcc, unknown record
+static const uint8_t V2_DATA[] = {
+  2, 0x01, 0x05,
+  18, 0x16, WNODE_UUID16_V2 & 0xFF, WNODE_UUID16_V2 >> 8,
+  WNODE_TLV_HEADER(WNODE_TLV_STATUS, 1), 0x06,
+  WNODE_TLV_HEADER(WNODE_TLV_TEMPERATURE, 2), 0x00, 0xFA,
+  WNODE_TLV_HEADER(WNODE_TLV_TEMPERATURE, 2), 0x00, 0x64,
+  WNODE_TLV_HEADER(WNODE_TLV_HUMIDITY, 2), 0x80, 0x00,
+  WNODE_TLV_HEADER(WNODE_TLV_VCC, 2), 0x0B, 0xB8,
+  0xF0
+};
+// telemetry with TX schedule
+static const uint8_t V2_TELEMETRY[] = {
+  2, 0x01, 0x05,
+  14, 0x16, WNODE_UUID16_V2 & 0xFF, WNODE_UUID16_V2 >> 8,
+  WNODE_TLV_HEADER(WNODE_TLV_TELEMETRY, 7), 64, 192, 1, 0, 0x12, 0x34, 0x05,
+  WNODE_TLV_HEADER(WNODE_TLV_SCHEDULE, 2), 0x06, 0xD6
+};
+
+static bool decode(const uint8_t* adv, size_t len, uint64_t mac, uint32_t time, Reading& r) {
+  return decodeAdvert(adv, len, mac, time, r);
+}
+
+int main()
+{
+  Reading r;
+
+  // v1
+  CHECK(decode(V1_DATA, sizeof(V1_DATA), 0xAA, 1, r));
+  CHECK(r.fields == Reading::HAS_DATA && r.mac == 0xAA && r.timeMs == 1);
+  CHECK(r.humidity == 450 && r.temperature == -123 && r.status == 0x01);
+
+  CHECK(decode(V1_TELEMETRY, sizeof(V1_TELEMETRY), 0xAA, 2, r));
+  CHECK(r.fields == Reading::HAS_TELEMETRY);
+  CHECK(r.telemetry.wakeups == 64 && r.telemetry.txPackets == 192 && r.telemetry.sensorReads == 1 && r.telemetry.sensorFails == 0);
+  CHECK(Telemetry::activeUs(r.telemetry.activeTime[0]) == (16 + 2) * 16);
+  CHECK(Telemetry::activeUs(r.telemetry.activeTime[1]) == ((16 + 4) << 2) * 16);
+  CHECK(Telemetry::activeUs(r.telemetry.activeTime[2]) == 5 * 16);
+
+  // v1 needs the name
+  uint8_t noName[sizeof(V1_DATA)];
+  memcpy(noName, V1_DATA, sizeof(V1_DATA));
+  noName[4] = 'x';
+  CHECK(!decode(noName, sizeof(noName), 0xAA, 1, r));
+
+  // v2, the first probe is the temperature
+  CHECK(decode(V2_DATA, sizeof(V2_DATA), 0xBB, 3, r));
+  CHECK(r.fields == (Reading::HAS_DATA | Reading::HAS_VCC));
+  CHECK(r.temperature == 250 && r.humidity == NO_VALUE && r.status == 0x06 && r.vccMv == 3000);
+  CHECK(decode(V2_TELEMETRY, sizeof(V2_TELEMETRY), 0xBB, 4, r));
+  CHECK(r.fields == (Reading::HAS_TELEMETRY | Reading::HAS_SCHEDULE) && r.periodMs == 1750 && r.telemetry.txPackets == 192);
+
+  // malformed: AD structure or TLV record past the end
+  uint8_t truncated[sizeof(V2_DATA) - 1];
+  memcpy(truncated, V2_DATA, sizeof(truncated));
+  CHECK(!decode(truncated, sizeof(truncated), 0xBB, 3, r));
+  truncated[3] = 15;
+  CHECK(!decode(truncated, sizeof(truncated) - 1, 0xBB, 3, r));
+
+  // coalescing: one reading per MAC with the latest data and telemetry, sorted by MAC
+  Coalescer c(250);
+  std::vector<Reading> batch;
+  Reading a, t, b;
+  decode(V2_DATA, sizeof(V2_DATA), 0xBB, 10, b);
+  decode(V1_TELEMETRY, sizeof(V1_TELEMETRY), 0xAA, 20, t);
+  decode(V1_DATA, sizeof(V1_DATA), 0xAA, 30, a);
+  c.push(b);
+  c.push(t);
+  c.push(a);
+  c.push(b);
+  CHECK(c.pending() == 2);
+  CHECK(c.take(30, batch) == 2);
+  CHECK(batch[0].mac == 0xAA && batch[1].mac == 0xBB);
+  CHECK(batch[0].fields == (Reading::HAS_DATA | Reading::HAS_TELEMETRY) && batch[0].timeMs == 30);
+  CHECK(batch[0].temperature == -123 && batch[0].telemetry.wakeups == 64);
+  CHECK(c.pending() == 0);
+
+  // at most one batch per interval
+  c.push(a);
+  CHECK(!c.due(279) && c.take(279, batch) == 0 && batch.empty());
+  CHECK(c.due(280) && c.take(280, batch) == 1);
+  CHECK(!c.due(1000) && c.take(1000, batch) == 0);
+
+  // flush takes whatever is pending right away
+  c.push(b);
+  CHECK(c.flush(1001, batch) == 1 && batch[0].mac == 0xBB);
+  CHECK(c.flush(1002, batch) == 0);
+
+  printf("wnode_scan_test: %s\n", fails? "FAIL" : "OK");
+  return fails? 1 : 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Weather Node Station
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+import { WeatherNode, EnergyProfile } from './SensorListScreen';
+
+//telemetry (see readme) as shown in the list and shared as CSV
+
+//mean active time per wakeup, ms
+export const activeMsPerWakeup = (e: EnergyProfile) => {
+  const { sensor, radio, other } = e.activeMsPerWindow;
+  return e.wakeups? (sensor + radio + other) / e.wakeups : 0;
+};
+
+export const formatEnergyProfile = (e: EnergyProfile) =>
+  `${e.wakeups} wakeups, ${e.txPackets} TX, ${e.sensorReads} reads (${e.sensorFailures} failed), ` +
+  `active ${activeMsPerWakeup(e).toFixed(2)} ms/wakeup`;
+
+const csvField = (v: string | number) => {
+  const s = String(v);
+  return /[",\n]/.test(s)? `"${s.replace(/"/g, '""')}"` : s;
+};
+
+//one line per node that has sent telemetry
+export const energyCsv = (nodes: Record<string, WeatherNode>, nodeNames: Record<string, string>) => [
+  'mac,name,updated,wakeups,tx_packets,sensor_reads,sensor_failures,sensor_ms,radio_ms,other_ms',
+  ...Object.values(nodes).filter(node => node.energy).map(({ mac, name, energy }) => {
+    const e = energy as EnergyProfile;
+    const { sensor, radio, other } = e.activeMsPerWindow;
+    return [mac, nodeNames[mac] ?? name, e.updated, e.wakeups, e.txPackets, e.sensorReads, e.sensorFailures, sensor, radio, other]
+      .map(csvField).join(',');
+  })
+].join('\n');
@@ -0,0 +1,162 @@
+/*
+ * Weather Node Station
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+/*
+  Streaming outlier filter for sensor readings (see img/mad-DHT22.png).
+  A sample is rejected if it's a Hampel outlier (too far from the median of the last readings)
+  or if it changes faster than the physical quantity can change since the last accepted sample
+  (unless the window median has already moved there).
+  Rejected samples still go into the window, so a real step change gets accepted once it persists.
+  Every sample that goes into the window is also kept in a fixed-size history with its filtered value,
+  so both series can be queried.
+*/
+
+const WINDOW = 5;
+const MIN_SAMPLES = 3;      //accept everything until the window has that many readings
+const HAMPEL_K = 3;
+const MAD_TO_SIGMA = 1.4826;
+//nodes repeat the same reading in every advert until the next sensor poll (2 min), a repeated value
+//goes into the window once in that period: a single bad poll gets 2 samples at most, a real step gets 3 by the next poll
+const REPEAT_SAMPLE_MS = 60000;
+const HISTORY_LENGTH = 720; //a day of 2 min polls
+
+export interface GlitchFilterParams {
+  minDeviation: number;     //deviations below that are never rejected (sensor resolution / noise)
+  maxRatePerMin: number;    //max change per minute since the last accepted sample
+}
+
+export interface FilteredSample {
+  value: number;            //last accepted value
+  rejected: boolean;        //the incoming sample has been rejected
+}
+
+export interface HistorySample {
+  time: number;
+  raw: number;
+  filtered: number;         //last accepted value at that time
+  rejected: boolean;
+}
+
+interface History {         //ring buffers
+  time: Float64Array;
+  raw: Float64Array;
+  filtered: Float64Array;
+  rejected: Uint8Array;
+  count: number;
+  pos: number;
+}
+
+interface ChannelState {
+  window: Float64Array;     //ring buffer of raw readings
+  count: number;
+  pos: number;
+  lastRaw: number;
+  lastRawTime: number;
+  accepted: number;
+  acceptedTime: number;
+  rejected: boolean;
+  history: History;
+}
+
+const median = (v: Float64Array, n: number, tmp: Float64Array) => {
+  for(let i = 0; i < n; ++i) tmp[i] = v[i];
+  const s = tmp.subarray(0, n).sort();
+  return n % 2? s[n >> 1] : (s[(n >> 1) - 1] + s[n >> 1]) / 2;
+};
+
+const newHistory = (length: number): History => ({
+  time: new Float64Array(length),
+  raw: new Float64Array(length),
+  filtered: new Float64Array(length),
+  rejected: new Uint8Array(length),
+  count: 0, pos: 0
+});
+
+const pushHistory = (h: History, time: number, raw: number, filtered: number, rejected: boolean) => {
+  h.time[h.pos] = time;
+  h.raw[h.pos] = raw;
+  h.filtered[h.pos] = filtered;
+  h.rejected[h.pos] = rejected? 1 : 0;
+  h.pos = (h.pos + 1) % h.time.length;
+  if(h.count < h.time.length) ++h.count;
+};
+
+export class GlitchFilter {
+  private channels: Record<string, ChannelState> = {};
+  private tmp = new Float64Array(WINDOW);
+
+  constructor(private params: GlitchFilterParams, private historyLength = HISTORY_LENGTH) {}
+
+  //key identifies the channel (node + quantity), now is in ms
+  filter(key: string, value: number, now: number): FilteredSample {
+    const ch = this.channels[key];
+    if(!ch) {
+      const history = newHistory(this.historyLength);
+      pushHistory(history, now, value, value, false);
+      this.channels[key] = {
+        window: new Float64Array(WINDOW).fill(value),
+        count: 1, pos: 1 % WINDOW,
+        lastRaw: value, lastRawTime: now, accepted: value, acceptedTime: now, rejected: false,
+        history
+      };
+      return { value, rejected: false };
+    }
+
+    if(value === ch.lastRaw && now - ch.lastRawTime < REPEAT_SAMPLE_MS) return { value: ch.accepted, rejected: ch.rejected };
+    ch.lastRaw = value;
+    ch.lastRawTime = now;
+
+    let rejected = false;
+    if(ch.count >= MIN_SAMPLES) {
+      const { minDeviation, maxRatePerMin } = this.params;
+      const tmp = this.tmp;
+      const n = ch.count;
+      const med = median(ch.window, n, tmp);
+      for(let i = 0; i < n; ++i) tmp[i] = Math.abs(ch.window[i] - med);
+      const mad = median(tmp, n, tmp);
+      const minutes = (now - ch.acceptedTime) / 60000;
+      const dev = Math.abs(value - med);
+      rejected =
+        dev > Math.max(HAMPEL_K * MAD_TO_SIGMA * mad, minDeviation) ||
+        (dev > minDeviation && Math.abs(value - ch.accepted) > maxRatePerMin * minutes + minDeviation);
+    }
+
+    ch.window[ch.pos] = value;
+    ch.pos = (ch.pos + 1) % WINDOW;
+    if(ch.count < WINDOW) ++ch.count;
+    ch.rejected = rejected;
+    if(!rejected) {
+      ch.accepted = value;
+      ch.acceptedTime = now;
+    }
+    pushHistory(ch.history, now, value, ch.accepted, rejected);
+    return { value: ch.accepted, rejected };
+  }
+
+  //samples of the channel since 'from' (ms), oldest first
+  history(key: string, from = -Infinity): HistorySample[] {
+    const h = this.channels[key]?.history;
+    const res: HistorySample[] = [];
+    if(!h) return res;
+    const len = h.time.length;
+    for(let i = 0; i < h.count; ++i) {
+      const j = (h.pos - h.count + i + len) % len;
+      if(h.time[j] >= from) res.push({ time: h.time[j], raw: h.raw[j], filtered: h.filtered[j], rejected: h.rejected[j] === 1 });
+    }
+    return res;
+  }
+
+  //drop channels (state and history) that haven't had a sample since 'olderThan' (ms)
+  evict(olderThan: number) {
+    for(const key of Object.keys(this.channels))
+      if(this.channels[key].lastRawTime < olderThan) delete this.channels[key];
+  }
+
+  clear() {
+    this.channels = {};
+  }
+}
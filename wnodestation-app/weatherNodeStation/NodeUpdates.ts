@@ -0,0 +1,49 @@
+/*
+ * Weather Node Station
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+import { WeatherNode } from './SensorListScreen';
+import { NodeUpdate } from './WeatherNodeDecoder';
+
+//telemetry frame alone doesn't make a node, it is attached to a node once its data arrives
+export const mergeNodeUpdates = (nodes: Record<string, WeatherNode>, updates: Record<string, NodeUpdate>) => {
+  const res = {...nodes};
+  Object.values(updates).forEach(update => {
+    const node = {...res[update.mac], ...update};
+    if(node.temperature !== undefined) res[update.mac] = node as WeatherNode;
+  });
+  return res;
+};
+
+//coalesces updates by MAC and hands them over in batches, at most one per intervalMs;
+//the timer runs only while there's something pending
+export const createUpdateBatcher = (onBatch: (batch: Record<string, NodeUpdate>) => void, intervalMs: number) => {
+  let pending: Record<string, NodeUpdate> = {};
+  let timerId: ReturnType<typeof setTimeout> | undefined;
+
+  //hands over whatever is pending right away (e.g. when the scan stops)
+  const flush = () => {
+    if(timerId) clearTimeout(timerId);
+    timerId = undefined;
+    const batch = pending;
+    pending = {};
+    if(Object.keys(batch).length) onBatch(batch);
+  };
+
+  const push = (update: NodeUpdate) => {
+    pending[update.mac] = {...pending[update.mac], ...update};
+    if(!timerId) timerId = setTimeout(flush, intervalMs);
+  };
+
+  return { push, flush };
+};
+
+//by 1min group (most recent first), then by name; each date is parsed once, not on every comparison
+export const sortNodes = (nodes: Record<string, WeatherNode>, nodeNames: Record<string, string>) =>
+  Object.values(nodes)
+    .map(node => ({node, title: nodeNames[node.mac] ?? node.mac, group: Math.round(new Date(node.updated).getTime() / 60000)}))
+    .sort((n1, n2) => (n2.group - n1.group) || n1.title.localeCompare(n2.title))
+    .map(({node}) => node);
@@ -11,6 +11,7 @@ import { WNodeListItem } from './WNodeListItem';
 import { SensorNameForm } from './SensorNameForm';
 import { WeatherNode } from './SensorListScreen';
 import { Touchable } from './Touchable';
+import { sortNodes } from './NodeUpdates';
 
 export interface SensorListProps {
   nodes: Record<string, WeatherNode>;
@@ -23,11 +24,7 @@ export interface SensorListProps {
 export const SensorList = ({nodes, nodeNames, setNodeName, scanError, restartScan}: SensorListProps) => {
   const [showModalSetName, setShowModalSetName] = React.useState<string>();
 
-  const nodesSorted = React.useMemo(() => 
-    Object.values(nodes)
-      .sort((n1, n2) => (nodeNames[n1.mac] ?? n1.mac).localeCompare(nodeNames[n2.mac] ?? n2.mac))   //sord by name
-      .sort((n1, n2) => Math.round(new Date(n2.updated).getTime() / 60000) - Math.round(new Date(n1.updated).getTime() / 60000)) //sort by 60min group
-  , [nodes, nodeNames]);
+  const nodesSorted = React.useMemo(() => sortNodes(nodes, nodeNames), [nodes, nodeNames]);
 
   return (
     <>
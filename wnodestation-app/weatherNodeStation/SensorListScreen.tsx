@@ -6,11 +6,14 @@
  */
 
 import React from 'react';
-import { StyleSheet, Text, View, Image, Alert } from 'react-native';
+import { StyleSheet, Text, View, Image, Alert, Share } from 'react-native';
 import { BleManager, Device as BleDevice, BleError } from 'react-native-ble-plx';
-import { Buffer } from 'buffer';
 import AsyncStorage from '@react-native-community/async-storage';
 import { SensorList } from './SensorList';
+import { GlitchFilter } from './GlitchFilter';
+import { decodeWeatherNode, NodeUpdate } from './WeatherNodeDecoder';
+import { energyCsv } from './EnergyReport';
+import { mergeNodeUpdates, createUpdateBatcher } from './NodeUpdates';
 import { MenuProvider } from 'react-native-popup-menu';
 import {
   Menu,
@@ -20,14 +23,35 @@ import {
 } from 'react-native-popup-menu';
 const appVersion: string = require('../package.json').version;
 
+const NODES_SAVE_INTERVAL_MS = 30000;
+const SCAN_BATCH_INTERVAL_MS = 250;
+const GLITCH_EVICT_INTERVAL_MS = 600000;
+const GLITCH_STALE_MS = 24 * 3600000; //a node not heard of for a day loses its filter state and history
+
 export interface WeatherNode {
   mac: string;
   name: string;
   temperature: number;
   humidity?: number;
+  probes?: number[]; //all temperature probes of a multi-sensor node (v2 frame) as received, not filtered; first one is raw 'temperature'
+  pressure?: number; //hPa
+  vcc?: number; //V
   batteryLevel?: 'high' | 'medium-high' | 'medium-low' | 'low';
   error?: string;
   updated: string;
+  energy?: EnergyProfile;
+  raw?: { temperature: number; humidity?: number }; //unfiltered readings, temperature/humidity hold filtered ones
+  glitch?: boolean; //the latest reading has been rejected by the glitch filter
+}
+
+//decoded telemetry frame; counters are for the node's last reporting window
+export interface EnergyProfile {
+  wakeups: number;
+  txPackets: number;
+  sensorReads: number;
+  sensorFailures: number;
+  activeMsPerWindow: { sensor: number; radio: number; other: number };
+  updated: string;
 }
 
 export const SensorListScreen = () => {
@@ -51,14 +75,54 @@ export const SensorListScreen = () => {
     } else setNodeNames(names => ({...names, [mac]: name}))
   };
 
-  //save and resore node names and vaules
+  //resore node names and vaules (keep whatever has been received while loading),
+  //a key is saved only after it's been read: if the read has failed, saving would wipe the stored data
+  const [restored, setRestored] = React.useState({ names: false, nodes: false });
   React.useEffect(() => {
-    AsyncStorage.getItem('node-names').then(v => v && setNodeNames(JSON.parse(v)));
-    AsyncStorage.getItem('nodes').then(v => v && setNondes(JSON.parse(v)));
-    return () => {
-      setNodeNames(names => (AsyncStorage.setItem('node-names', JSON.stringify(names)), names));
-      setNondes(nodes => (AsyncStorage.setItem('nodes', JSON.stringify(nodes)), nodes));
-    }
+    readStored('node-names')
+      .then(stored => {
+        if(stored) setNodeNames(names => ({...stored, ...names}));
+        setRestored(r => ({...r, names: true}));
+      })
+      .catch(e => console.log(e));
+    readStored('nodes')
+      .then(stored => {
+        if(stored) setNondes(nodes => ({...stored, ...nodes}));
+        setRestored(r => ({...r, nodes: true}));
+      })
+      .catch(e => console.log(e));
+  }, []);
+
+  //names change rarely, save them right away (but not before they change)
+  const namesRestored = React.useRef<Record<string, string>>();
+  React.useEffect(() => {
+    if(!restored.names) return;
+    if(!namesRestored.current) namesRestored.current = nodeNames;
+    else if(namesRestored.current !== nodeNames) AsyncStorage.setItem('node-names', JSON.stringify(nodeNames));
+  }, [restored.names, nodeNames]);
+
+  //nodes change every few seconds, save them periodically (so a crash won't lose everything) and on unmount
+  const nodesRef = React.useRef(nodes);
+  nodesRef.current = nodes;
+  React.useEffect(() => {
+    if(!restored.nodes) return;
+    let saved = nodesRef.current;
+    const save = () => {
+      if(saved === nodesRef.current) return;
+      saved = nodesRef.current;
+      AsyncStorage.setItem('nodes', JSON.stringify(saved));
+    };
+    const id = setInterval(save, NODES_SAVE_INTERVAL_MS);
+    return () => { clearInterval(id); save(); };
+  }, [restored.nodes]);
+
+  React.useEffect(() => {
+    const id = setInterval(() => {
+      const olderThan = Date.now() - GLITCH_STALE_MS;
+      glitchFilters.temperature.evict(olderThan);
+      glitchFilters.humidity.evict(olderThan);
+    }, GLITCH_EVICT_INTERVAL_MS);
+    return () => clearInterval(id);
   }, []);
 /*
   //generate fake sensors
@@ -72,7 +136,10 @@ export const SensorListScreen = () => {
   //scan effect
   React.useEffect(() => {
     setScanError(undefined);
-    
+
+    //coalesce updates by MAC and hand them over to react in batches (one re-render per batch)
+    const batcher = createUpdateBatcher(batch => setNondes(nodes => mergeNodeUpdates(nodes, batch)), SCAN_BATCH_INTERVAL_MS);
+
     const stopScan = scanBleWeatherNodes((error, device) => {
       if(error) {
         console.log(error);
@@ -80,33 +147,17 @@ export const SensorListScreen = () => {
         return;
       }
 
-      if(device?.name?.startsWith("wNode") && device.manufacturerData) {
-        const mbuff = new Buffer(device.manufacturerData, 'base64');
-        if(mbuff.length >= 8 && mbuff[0] == 0xA9 &&  mbuff[1] == 0x53) {
-          const isActive = (byteH: number, byteL: number) => !(byteH === 0x80 && byteL === 0);
-          const toInt16 = (byteH: number, byteL: number) => (((byteH & 0x7F) << 8) + byteL) * ((byteH & 0x80)? -1 : 1);
-          const humidity = isActive(mbuff[2], mbuff[3])? toInt16(mbuff[2], mbuff[3])/10 : undefined;
-          const temperature = toInt16(mbuff[4], mbuff[5])/10;
-          const flags = mbuff[6];
-          const batteryLevel = ['high', 'medium-high', 'medium-low', 'low'][flags&0x3] as any;
-          const error = flags&0x4? 'sensor failure' : undefined;
-
-          console.log(device.id, device.name, temperature, humidity, flags, batteryLevel);
-          
-          addNode({
-            mac: device.id,
-            name: device.name,
-            temperature,
-            humidity,
-            batteryLevel,
-            error,
-            updated: new Date().toString()
-          });
-        }
+      const update = device && decodeWeatherNode(device);
+      if(update) {
+        filterGlitches(update, Date.now());
+        batcher.push(update);
       }
     });
 
-    return stopScan;
+    return () => {
+      stopScan();
+      batcher.flush();
+    };
   }, [scanFlag]);
 
   const clearSensorsAlert = React.useCallback(() => {
@@ -115,12 +166,21 @@ export const SensorListScreen = () => {
       'Delete all sensors?',
       [
         { text: 'Cancel', style: 'cancel' },
-        { text: 'OK', onPress: () => { setNondes({}); setNodeNames({}); } }
+        { text: 'OK', onPress: () => {
+          setNondes({});
+          setNodeNames({});
+          glitchFilters.temperature.clear();
+          glitchFilters.humidity.clear();
+        } }
       ],
       {cancelable: true}
     );
   }, []);
 
+  const shareTelemetry = () => {
+    Share.share({ title: 'Weather Node telemetry', message: energyCsv(nodes, nodeNames) }).catch(e => console.log(e));
+  };
+
   return (<MenuProvider>
     <View style={styles.container}>
 
@@ -137,6 +197,9 @@ export const SensorListScreen = () => {
             <MenuOption onSelect={clearSensorsAlert} >
               <Text style={styles.menuOptionText}>Clear sensors</Text>
             </MenuOption>
+            <MenuOption onSelect={shareTelemetry} >
+              <Text style={styles.menuOptionText}>Share telemetry</Text>
+            </MenuOption>
             <MenuOption onSelect={() => Alert.alert(`About`, `Weather Node Station ${appVersion}`)} >
               <Text style={styles.menuOptionText}>About</Text>
             </MenuOption>
@@ -174,6 +237,17 @@ const styles = StyleSheet.create({
   }
 });
 
+//stored JSON, undefined if there's none; corrupt JSON is dropped (and overwritten by the next save),
+//rejects only if the storage can't be read
+const readStored = (key: string) => AsyncStorage.getItem(key).then(v => {
+  try {
+    return v? JSON.parse(v) : undefined;
+  } catch(e) {
+    console.log(e);
+    return undefined;
+  }
+});
+
 const scanBleWeatherNodes = (onScan: (error: BleError | null, device: BleDevice | null) => void) => {
   const bleManager = new BleManager();
   bleManager.startDeviceScan(
@@ -184,6 +258,28 @@ const scanBleWeatherNodes = (onScan: (error: BleError | null, device: BleDevice
   return () => bleManager.stopDeviceScan();
 };
 
+//outlier filters keep state between scan restarts
+const glitchFilters = {
+  temperature: new GlitchFilter({ minDeviation: 1, maxRatePerMin: 2 }),
+  humidity: new GlitchFilter({ minDeviation: 5, maxRatePerMin: 10 })
+};
+
+//raw and filtered readings of a node kept by the glitch filters (bounded, oldest first)
+export const readingHistory = (mac: string, from?: number) => ({
+  temperature: glitchFilters.temperature.history(mac, from),
+  humidity: glitchFilters.humidity.history(mac, from)
+});
+
+const filterGlitches = (update: NodeUpdate, now: number) => {
+  if(update.temperature === undefined) return;
+  const t = glitchFilters.temperature.filter(update.mac, update.temperature, now);
+  const h = update.humidity === undefined? undefined : glitchFilters.humidity.filter(update.mac, update.humidity, now);
+  update.raw = { temperature: update.temperature, humidity: update.humidity };
+  update.temperature = t.value;
+  if(h) update.humidity = h.value;
+  update.glitch = t.rejected || h?.rejected;
+};
+
 const genFakeMac = () => "00:11:22:CC:" + Math.random().toString().substr(2,2) + ":" + Math.random().toString().substr(2,2);
 const genFakeNode = (mac: string): WeatherNode => {
   const temperature = Math.round(Math.random()*10000)/100;
@@ -9,6 +9,7 @@ import React from 'react';
 import { StyleSheet, Text, View, Image } from 'react-native';
 import { WeatherNode } from './SensorListScreen';
 import { format } from 'date-fns';
+import { formatEnergyProfile } from './EnergyReport';
 
 export interface WeatherNodeListItemProps {
   node: WeatherNode;
@@ -43,6 +44,12 @@ export const WNodeListItem = ({node, title}: WeatherNodeListItemProps) => {
           }
         </View>
       </View>
+      { !node.glitch || !node.raw? null :
+        <Text style={styles.energyText}>{`Rejected reading: ${node.raw.temperature}°C` + (node.raw.humidity === undefined? '' : ` ${node.raw.humidity}%`)}</Text>
+      }
+      { !node.energy? null :
+        <Text style={styles.energyText}>{formatEnergyProfile(node.energy)}</Text>
+      }
     </View>
   );
 };
@@ -67,6 +74,11 @@ const styles = StyleSheet.create({
     color: '#000',
     marginBottom: 3,
     width: '50%'
+  },
+  energyText: {
+    fontSize: 12,
+    color: '#557',
+    marginBottom: 3
   }
 });
 
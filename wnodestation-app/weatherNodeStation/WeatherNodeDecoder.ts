@@ -0,0 +1,118 @@
+/*
+ * Weather Node Station
+ * author: github.com/AlexIII
+ * e-mail: endoftheworld@bk.ru
+ * license: MIT
+ */
+
+import { Device as BleDevice } from 'react-native-ble-plx';
+import { Buffer } from 'buffer';
+import { WeatherNode, EnergyProfile } from './SensorListScreen';
+
+//decoders of the advertising frames sent by the nodes (see readme), ble-plx device in, partial node out
+
+export type NodeUpdate = Partial<WeatherNode> & { mac: string };
+
+const batteryLevels: WeatherNode['batteryLevel'][] = ['high', 'medium-high', 'medium-low', 'low'];
+const isActive = (byteH: number, byteL: number) => !(byteH === 0x80 && byteL === 0);
+const toInt16 = (byteH: number, byteL: number) => (((byteH & 0x7F) << 8) + byteL) * ((byteH & 0x80)? -1 : 1);
+
+const ACTIVE_TIME_UNIT_MS = 0.016;
+//8-bit float: exponent in bits 4-7, mantissa in bits 0-3
+const minifloat = (v: number) => (v >> 4)? (16 + (v & 0xF)) * 2 ** ((v >> 4) - 1) : v;
+
+//v2 frame schema, the same names as in wnode2-arduino-firmware/wnode_frame.h without WNODE_ prefix
+//(__tests__/FrameSchema-test.ts checks that they match)
+export const WNODE_FRAME = {
+  UUID16_V2: 0xA953,
+  TLV_SPACE: 14,
+  TLV_STATUS: 0x1,
+  TLV_STATUS_LEN: 1,
+  TLV_TEMPERATURE: 0x2,
+  TLV_TEMPERATURE_LEN: 2,
+  TLV_HUMIDITY: 0x3,
+  TLV_HUMIDITY_LEN: 2,
+  TLV_PRESSURE: 0x4,
+  TLV_PRESSURE_LEN: 2,
+  TLV_VCC: 0x5,
+  TLV_VCC_LEN: 2,
+  TLV_TELEMETRY: 0x6,
+  TLV_TELEMETRY_LEN: 7,
+  TLV_AUTH_DATA: 0x7,
+  TLV_AUTH_DATA_LEN: 12,
+  AUTH_MIC_LEN: 4,
+  TLV_SCHEDULE: 0x8,
+  TLV_SCHEDULE_LEN: 2
+};
+const F = WNODE_FRAME;
+const WNODE_V2_SERVICE_UUID = `0000${F.UUID16_V2.toString(16)}-0000-1000-8000-00805f9b34fb`;
+
+const decodeEnergyProfile = (b: Buffer, o: number): EnergyProfile => ({
+  wakeups: b[o],
+  txPackets: b[o + 1],
+  sensorReads: b[o + 2],
+  sensorFailures: b[o + 3],
+  activeMsPerWindow: {
+    sensor: minifloat(b[o + 4]) * ACTIVE_TIME_UNIT_MS,
+    radio: minifloat(b[o + 5]) * ACTIVE_TIME_UNIT_MS,
+    other: minifloat(b[o + 6]) * ACTIVE_TIME_UNIT_MS
+  },
+  updated: new Date().toString()
+});
+
+const decodeStatus = (flags: number) => ({
+  batteryLevel: batteryLevels[flags&0x3],
+  error: flags&0x4? 'sensor failure' : undefined
+});
+
+export const decodeWeatherNode = (device: BleDevice): NodeUpdate | undefined => {
+  const serviceData = device.serviceData?.[WNODE_V2_SERVICE_UUID];
+  if(serviceData) return decodeWeatherNodeV2(device, Buffer.from(serviceData, 'base64'));
+
+  if(!device.name?.startsWith("wNode") || !device.manufacturerData) return undefined;
+  const mbuff = Buffer.from(device.manufacturerData, 'base64');
+  if(mbuff.length < 8 || mbuff[0] !== 0xA9) return undefined;
+  if(mbuff[1] === 0x54) return mbuff.length < 9? undefined : { mac: device.id, energy: decodeEnergyProfile(mbuff, 2) };
+  if(mbuff[1] !== 0x53) return undefined;
+  return {
+    mac: device.id,
+    name: device.name,
+    temperature: toInt16(mbuff[4], mbuff[5])/10,
+    humidity: isActive(mbuff[2], mbuff[3])? toInt16(mbuff[2], mbuff[3])/10 : undefined,
+    ...decodeStatus(mbuff[6]),
+    updated: new Date().toString()
+  };
+};
+
+//v2: list of TLV records, header byte is type (high nibble) and data length (low nibble); unknown types are skipped
+const decodeWeatherNodeV2 = (device: BleDevice, b: Buffer): NodeUpdate | undefined => {
+  const update: NodeUpdate = { mac: device.id };
+  const probes: number[] = [];
+  let humidity: number | undefined;
+  for(let i = 0; i < b.length; ) {
+    const type = b[i] >> 4;
+    const len = b[i] & 0xF;
+    const o = i + 1;
+    i = o + len;
+    if(i > b.length) return undefined;
+    if(type === F.TLV_STATUS && len >= F.TLV_STATUS_LEN) Object.assign(update, decodeStatus(b[o]));
+    else if(type === F.TLV_TEMPERATURE && len >= F.TLV_TEMPERATURE_LEN) probes.push(toInt16(b[o], b[o + 1])/10);
+    else if(type === F.TLV_HUMIDITY && len >= F.TLV_HUMIDITY_LEN) humidity = isActive(b[o], b[o + 1])? toInt16(b[o], b[o + 1])/10 : undefined;
+    else if(type === F.TLV_PRESSURE && len >= F.TLV_PRESSURE_LEN) update.pressure = b.readUInt16BE(o)/10;
+    else if(type === F.TLV_VCC && len >= F.TLV_VCC_LEN) update.vcc = b.readUInt16BE(o)/1000;
+    else if(type === F.TLV_TELEMETRY && len >= F.TLV_TELEMETRY_LEN) update.energy = decodeEnergyProfile(b, o);
+    else if(type === F.TLV_AUTH_DATA && len >= F.TLV_AUTH_DATA_LEN) { //the app has no node keys, MIC isn't checked
+      humidity = isActive(b[o], b[o + 1])? toInt16(b[o], b[o + 1])/10 : undefined;
+      probes.push(toInt16(b[o + 2], b[o + 3])/10);
+      Object.assign(update, decodeStatus(b[o + 4]));
+    }
+  }
+  if(probes.length) {
+    update.name = device.name ?? 'wNode';
+    update.temperature = probes[0];
+    update.humidity = humidity;
+    update.probes = probes.length > 1? probes : undefined;
+    update.updated = new Date().toString();
+  }
+  return update;
+};